@@ -0,0 +1,34 @@
+#!/bin/bash
+# Runs every kernel through the simulator and reports the simulated IPC and
+# the simulator speed.
+#
+# Usage: bench.sh [sim options] kernel.txt...
+
+SIM=${SIM:-./sim}
+
+opts=()
+while [ $# -gt 0 ] && [ "${1:0:1}" = "-" ]
+do
+    opts+=("$1" "$2")
+    shift 2
+done
+
+if [ $# -lt 1 ]
+then
+    echo "Usage: bench.sh [sim options] kernel.txt..."
+    exit 1
+fi
+
+printf "%-12s %10s %10s %7s %10s %10s\n" "kernel" "instret" "cycles" "ipc" "host(s)" "KIPS"
+
+for f in "$@"
+do
+    k=$(basename "${f%.*}")
+    $SIM "${opts[@]}" "$f" | awk -v k="$k" -F': *' '
+        /^cycles/    { c = $2 }
+        /^instret/   { i = $2 }
+        /^ipc/       { p = $2 }
+        /^host time/ { h = $2 + 0 }
+        /^sim speed/ { s = $2 + 0 }
+        END { printf "%-12s %10d %10d %7.3f %10.6f %10.1f\n", k, i, c, p, h, s }'
+done
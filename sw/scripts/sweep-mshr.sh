@@ -0,0 +1,41 @@
+#!/bin/bash
+# IPC of a kernel for every ROB size and MSHR count, shows where memory
+# bound code stops scaling.
+#
+# Usage: sweep-mshr.sh [sim options] kernel.txt
+
+SIM=${SIM:-./sim}
+ROBS=${ROBS:-"16 32 64 128"}
+MSHRS=${MSHRS:-"1 2 4 8 16"}
+CACHE=${CACHE:-"8192:4:64:2"}
+
+opts=()
+while [ $# -gt 0 ] && [ "${1:0:1}" = "-" ]
+do
+    opts+=("$1" "$2")
+    shift 2
+done
+
+if [ $# -ne 1 ]
+then
+    echo "Usage: sweep-mshr.sh [sim options] kernel.txt"
+    exit 1
+fi
+
+printf "%-8s" "rob\\mshr"
+for m in $MSHRS
+do
+    printf " %7s" "$m"
+done
+printf "\n"
+
+for r in $ROBS
+do
+    printf "%-8s" "$r"
+    for m in $MSHRS
+    do
+        ipc=$($SIM "${opts[@]}" -r "$r" -C "$CACHE:$m" "$1" | awk -F': *' '/^ipc/ { print $2 }')
+        printf " %7s" "$ipc"
+    done
+    printf "\n"
+done
@@ -41,6 +41,7 @@
 #define OP_LOAD     0b00000
 #define OP_MISC_MEM 0b00011
 #define OP_SYSTEM   0b11100
+#define OP_AMO      0b01011
 
 // R and I FUNCT
 #define FUNCT3_ADDSUB 0b000
@@ -90,6 +91,20 @@
 #define FM_TSO       0b1000
 #define FUNCT3_FENCE 0b000
 
+// ATOMIC, funct5 is the upper part of funct7 above the aq and rl bits
+#define FUNCT3_AMO_W     0b010
+#define FUNCT5_LR        0b00010
+#define FUNCT5_SC        0b00011
+#define FUNCT5_AMOSWAP   0b00001
+#define FUNCT5_AMOADD    0b00000
+#define FUNCT5_AMOXOR    0b00100
+#define FUNCT5_AMOAND    0b01100
+#define FUNCT5_AMOOR     0b01000
+#define FUNCT5_AMOMIN    0b10000
+#define FUNCT5_AMOMAX    0b10100
+#define FUNCT5_AMOMINU   0b11000
+#define FUNCT5_AMOMAXU   0b11100
+
 // REGISTERS NAME
 #define REG_X00 0b00000
 #define REG_X01 0b00001
@@ -0,0 +1,485 @@
+#include "cache.h"
+#include "prof.h"
+
+#define RPT_SIZE        64      // Entries of the stride prefetcher
+#define NB_STREAMS      4
+
+const char *prefetch_names[NB_PREFETCHERS] = {
+        [PREFETCH_NONE]      = "none",
+        [PREFETCH_NEXT_LINE] = "next-line",
+        [PREFETCH_STRIDE]    = "stride",
+        [PREFETCH_STREAM]    = "stream",
+};
+
+
+enum line_state {
+        LINE_S,
+        LINE_E,
+        LINE_M
+};
+
+
+static CORE_LOCAL struct cache {
+        struct cache_param p;
+        int nb_sets;
+        int line_bits;
+        uint64_t now;
+
+        struct line {
+                uint32_t addr;          // Line address, addr >> line_bits
+                uint64_t ready;         // Cycle the fill returns
+                uint64_t used;          // Last access, for LRU
+                uint64_t owned;         // Cycle the write permission arrives
+                bool valid;
+                bool prefetched;        // Brought by the prefetcher, not used yet
+                uint8_t state;          // Coherence state, enum line_state
+        } *lines;
+
+        // Reference prediction table, indexed by PC
+        struct rpt {
+                uint32_t pc;
+                uint32_t addr;
+                int32_t stride;
+                int conf;               // 2 bit saturating counter
+                bool valid;
+        } rpt[RPT_SIZE];
+
+        // Fifos of the lines fetched after a miss
+        struct stream {
+                uint32_t *line;
+                uint64_t *ready;
+                int head;
+                int cnt;
+                uint32_t next;          // Next line to fetch
+                uint64_t used;
+        } stream[NB_STREAMS];
+
+        uint64_t *mshr;         // Cycle the fill of each MSHR returns
+
+        struct cache_stats stats;
+} cache = {0};
+
+
+// Holds an MSHR until the fill returns, returns 0 if they are all busy
+static int mshr_alloc(uint64_t ready) {
+        if (!cache.p.nb_mshr)
+                return 1;
+
+        for (int i = 0; i < cache.p.nb_mshr; i++) {
+                if (cache.mshr[i] <= cache.now) {
+                        cache.mshr[i] = ready;
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+
+static bool mshr_full(void) {
+        for (int i = 0; i < cache.p.nb_mshr; i++)
+                if (cache.mshr[i] <= cache.now)
+                        return false;
+
+        return cache.p.nb_mshr != 0;
+}
+
+
+static struct line *lookup(uint32_t ln) {
+        struct line *set = &cache.lines[(ln % cache.nb_sets) * cache.p.ways];
+
+        for (int w = 0; w < cache.p.ways; w++)
+                if (set[w].valid && set[w].addr == ln)
+                        return &set[w];
+
+        return NULL;
+}
+
+
+// State of a new copy, from the cache of the core that may write the line
+// if there is one. MESI grants a line no other core holds exclusive
+static void share(struct line *l) {
+        int owner = coh_owner(l->addr);
+        uint32_t others = coh_sharers(l->addr) & ~(1u << cache.p.core);
+
+        if (owner >= 0 && owner != cache.p.core) {
+                l->ready = cache.now + cache.p.c2c_latency;
+                cache.stats.coh_c2c++;
+        }
+
+        if (cache.p.coherence == COH_MESI && !others && (owner < 0 || owner == cache.p.core)) {
+                l->state = LINE_E;
+                coh_request(cache.p.core, l->addr, COH_READ_EXCL);
+        } else {
+                l->state = LINE_S;
+                coh_request(cache.p.core, l->addr, COH_READ);
+        }
+}
+
+
+// Write permission, an E line becomes M silently, an S line invalidates the
+// other copies. Returns 0 until the permission is there
+static int own(struct line *l) {
+        if (l->state == LINE_S) {
+                uint32_t others = coh_sharers(l->addr) & ~(1u << cache.p.core);
+                int owner = coh_owner(l->addr);
+
+                if (owner >= 0 && owner != cache.p.core)
+                        others |= 1u << owner;
+
+                l->state = LINE_M;
+                l->owned = cache.now + cache.p.inv_latency;
+                coh_request(cache.p.core, l->addr, COH_WRITE);
+                cache.stats.coh_upgrades++;
+                cache.stats.coh_invals += __builtin_popcount(others);
+        } else if (l->state == LINE_E) {
+                // Silent, the directory still needs to know when two cores
+                // got the line exclusive in the same quantum
+                coh_request(cache.p.core, l->addr, COH_WRITE);
+        }
+
+        l->state = LINE_M;
+
+        if (l->owned > cache.now) {
+                cache.stats.coh_stalls++;
+                return 0;
+        }
+
+        return 1;
+}
+
+
+// Replaces the LRU line of the set
+static struct line *allocate(uint32_t ln) {
+        struct line *set = &cache.lines[(ln % cache.nb_sets) * cache.p.ways];
+        struct line *v = &set[0];
+
+        for (int w = 0; w < cache.p.ways && v->valid; w++)
+                if (!set[w].valid || set[w].used < v->used)
+                        v = &set[w];
+
+        if (v->valid && v->prefetched)
+                cache.stats.pf_useless++;
+
+        if (v->valid && cache.p.coherence)
+                coh_request(cache.p.core, v->addr, COH_EVICT);
+
+        *v = (struct line) {
+                .addr = ln,
+                .ready = cache.now + cache.p.miss_latency,
+                .used = cache.now,
+                .valid = true,
+                .prefetched = false,
+                .state = LINE_M,
+        };
+
+        if (cache.p.coherence)
+                share(v);
+
+        return v;
+}
+
+
+static void prefetch(uint32_t ln) {
+        if (lookup(ln))
+                return;
+
+        if (!mshr_alloc(cache.now + cache.p.miss_latency)) {
+                cache.stats.pf_dropped++;
+                return;
+        }
+
+        allocate(ln)->prefetched = true;
+        cache.stats.pf_issued++;
+}
+
+
+// First use of a prefetched line
+static void prefetch_hit(uint64_t ready) {
+        if (ready <= cache.now)
+                cache.stats.pf_useful++;
+        else
+                cache.stats.pf_late++;
+}
+
+
+static void stream_push(struct stream *s) {
+        if (!mshr_alloc(cache.now + cache.p.miss_latency)) {
+                cache.stats.pf_dropped++;
+                return;
+        }
+
+        int i = (s->head + s->cnt++) % cache.p.degree;
+
+        s->line[i] = s->next++;
+        s->ready[i] = cache.now + cache.p.miss_latency;
+        cache.stats.pf_issued++;
+}
+
+
+// Moves the line at the head of a stream buffer in the cache, the buffer
+// fetches one more line
+static struct line *stream_hit(uint32_t ln) {
+        for (int i = 0; i < NB_STREAMS; i++) {
+                struct stream *s = &cache.stream[i];
+
+                if (s->cnt && s->line[s->head] == ln) {
+                        struct line *l = allocate(ln);
+
+                        l->ready = s->ready[s->head];
+                        prefetch_hit(l->ready);
+
+                        s->head = (s->head + 1) % cache.p.degree;
+                        s->cnt--;
+                        s->used = cache.now;
+                        stream_push(s);
+
+                        return l;
+                }
+        }
+
+        return NULL;
+}
+
+
+// A miss in every buffer restarts the least recently used one
+static void stream_alloc(uint32_t ln) {
+        struct stream *lru = &cache.stream[0];
+
+        for (int i = 1; i < NB_STREAMS; i++)
+                if (cache.stream[i].used < lru->used)
+                        lru = &cache.stream[i];
+
+        cache.stats.pf_useless += lru->cnt;
+        *lru = (struct stream) {
+                .line = lru->line,
+                .ready = lru->ready,
+                .head = 0,
+                .cnt = 0,
+                .next = ln + cache.p.distance,
+                .used = cache.now,
+        };
+
+        for (int i = 0; i < cache.p.degree; i++)
+                stream_push(lru);
+}
+
+
+static void stride_train(uint32_t addr, uint32_t pc) {
+        struct rpt *e = &cache.rpt[(pc >> 2) % RPT_SIZE];
+
+        if (!e->valid || e->pc != pc) {
+                *e = (struct rpt) { .pc = pc, .addr = addr, .stride = 0, .conf = 0, .valid = true };
+                return;
+        }
+
+        int32_t d = addr - e->addr;
+
+        if (d == e->stride) {
+                if (e->conf < 3)
+                        e->conf++;
+        } else if (e->conf > 0) {
+                e->conf--;
+        } else {
+                e->stride = d;
+        }
+
+        e->addr = addr;
+
+        if (e->conf < 1 || e->stride == 0)
+                return;
+
+        for (int i = 0; i < cache.p.degree; i++)
+                prefetch((addr + e->stride * (cache.p.distance + i)) >> cache.line_bits);
+}
+
+
+// Demand access, returns the cycles before the line can be used or -1 if
+// it misses with every MSHR busy
+static int access(uint32_t addr, uint32_t pc) {
+        uint32_t ln = addr >> cache.line_bits;
+        struct line *l = lookup(ln);
+        bool trigger = false;   // Next-line prefetches on misses and prefetched lines
+
+        if (l) {
+                if (l->prefetched) {
+                        prefetch_hit(l->ready);
+                        l->prefetched = false;
+                        trigger = true;
+                } else if (l->ready > cache.now) {
+                        cache.stats.merges++;
+                }
+        } else if (cache.p.prefetch == PREFETCH_STREAM && (l = stream_hit(ln))) {
+                // Moved from a stream buffer
+        } else if (mshr_full()) {
+                cache.stats.mshr_stalls++;
+                return -1;
+        } else {
+                mshr_alloc(cache.now + cache.p.miss_latency);
+                l = allocate(ln);
+                cache.stats.misses++;
+                cache.stats.fills++;
+                trigger = true;
+                prof_count(pc, PROF_L1D_MISSES, 1);
+
+                if (cache.p.prefetch == PREFETCH_STREAM)
+                        stream_alloc(ln);
+        }
+
+        l->used = cache.now;
+
+        if (cache.p.prefetch == PREFETCH_NEXT_LINE && trigger)
+                for (int i = 0; i < cache.p.degree; i++)
+                        prefetch(ln + cache.p.distance + i);
+        else if (cache.p.prefetch == PREFETCH_STRIDE)
+                stride_train(addr, pc);
+
+        if (l->ready > cache.now + cache.p.hit_latency)
+                return l->ready - cache.now;
+
+        return cache.p.hit_latency;
+}
+
+
+// ------- Global Functions -------- //
+
+void cache_destroy(void) {
+        if (cache.lines)
+                free(cache.lines);
+
+        if (cache.mshr)
+                free(cache.mshr);
+
+        for (int i = 0; i < NB_STREAMS; i++) {
+                if (cache.stream[i].line) free(cache.stream[i].line);
+                if (cache.stream[i].ready) free(cache.stream[i].ready);
+        }
+
+        cache = (struct cache) {0};
+}
+
+
+int cache_create(const struct cache_param *p) {
+
+        cache = (struct cache) { .p = *p, .now = 0 };
+
+        if (p->miss_latency < 1)
+                return EINVAL;
+
+        if (!p->size)
+                return 0;
+
+        if (p->ways < 1 || p->line_size < 4 || (p->line_size & (p->line_size - 1)) ||
+                        p->size % (p->ways * p->line_size) || p->hit_latency < 1 ||
+                        p->degree < 1 || p->distance < 1 || p->nb_mshr < 0 ||
+                        p->c2c_latency < 1 || p->inv_latency < 0)
+                return EINVAL;
+
+        cache.nb_sets = p->size / (p->ways * p->line_size);
+        cache.line_bits = clog2(p->line_size);
+        cache.lines = calloc(cache.nb_sets * p->ways, sizeof(*cache.lines));
+        cache.mshr = calloc(p->nb_mshr + 1, sizeof(*cache.mshr));
+
+        if (!cache.lines || !cache.mshr)
+                goto CLEANUP;
+
+        for (int i = 0; i < NB_STREAMS; i++) {
+                cache.stream[i].line = malloc(sizeof(*cache.stream[i].line) * p->degree);
+                cache.stream[i].ready = malloc(sizeof(*cache.stream[i].ready) * p->degree);
+
+                if (!cache.stream[i].line || !cache.stream[i].ready)
+                        goto CLEANUP;
+        }
+
+        return 0;
+
+CLEANUP:
+        cache_destroy();
+        return ENOMEM;
+}
+
+
+void cache_tick(void) {
+        cache.now++;
+}
+
+
+int cache_load(uint32_t addr, uint32_t pc) {
+        int latency = cache.p.size ? access(addr, pc) : cache.p.miss_latency;
+
+        if (latency >= 0)
+                cache.stats.loads++;
+
+        return latency;
+}
+
+
+int cache_store(uint32_t addr, uint32_t pc) {
+        if (cache.p.coherence && cache.p.size) {
+                struct line *l = lookup(addr >> cache.line_bits);
+
+                // Retried while the upgrade is on its way
+                if (l && l->owned > cache.now) {
+                        cache.stats.coh_stalls++;
+                        return 0;
+                }
+        }
+
+        if (cache.p.size && access(addr, pc) < 0)
+                return 0;
+
+        if (cache.p.coherence && cache.p.size && !own(lookup(addr >> cache.line_bits)))
+                return 0;
+
+        cache.stats.stores++;
+        return 1;
+}
+
+
+void cache_atomic(uint32_t addr) {
+        uint32_t ln = addr >> cache.line_bits;
+        struct line *l;
+
+        if (!cache.p.size)
+                return;
+
+        if ((l = lookup(ln))) {
+                if (l->prefetched)
+                        cache.stats.pf_useless++;
+                l->valid = false;
+        }
+
+        if (cache.p.coherence) {
+                uint32_t others = coh_sharers(ln) & ~(1u << cache.p.core);
+
+                coh_request(cache.p.core, ln, COH_ATOMIC);
+                cache.stats.coh_invals += __builtin_popcount(others);
+        }
+}
+
+
+void cache_sync(void) {
+        uint32_t ln;
+        enum coh_snoop s;
+
+        while (coh_snoop(cache.p.core, &ln, &s)) {
+                struct line *l = cache.p.size ? lookup(ln) : NULL;
+
+                if (!l)
+                        continue;
+
+                if (s == COH_DOWNGRADE) {
+                        l->state = LINE_S;
+                } else {
+                        if (l->prefetched)
+                                cache.stats.pf_useless++;
+                        l->valid = false;
+                        cache.stats.coh_snooped++;
+                }
+        }
+}
+
+
+void cache_get_stats(struct cache_stats *s) {
+        *s = cache.stats;
+}
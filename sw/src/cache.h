@@ -0,0 +1,106 @@
+/* L1 DATA CACHE
+ * Timing model of a set associative L1D with LRU replacement, the data
+ * itself stays in mem. A line is allocated as soon as it is requested and
+ * becomes usable once its fill returns from the next level, an access to a
+ * line still being filled waits for the rest of the fill.
+ *
+ * Every line on its way holds a miss status holding register, a miss to a
+ * line already on its way merges with it. A demand miss that finds every
+ * MSHR busy is refused and retried, a prefetch is dropped.
+ *
+ * Prefetchers are trained on the demand accesses:
+ *  - next-line: a miss, or the first hit on a prefetched line, fetches the
+ *    lines at +distance .. +distance+degree-1
+ *  - stride: a PC indexed reference prediction table, a confident entry
+ *    fetches degree strides starting distance strides ahead
+ *  - stream: stream buffers of degree lines allocated on misses starting
+ *    distance lines ahead, a miss that hits the head of a buffer moves the
+ *    line in the cache and the buffer fetches one more line
+ *
+ * In a cluster the lines carry an MSI/MESI state kept coherent by coh.c.
+ * A miss on a line another core may write comes from that core's cache
+ * after c2c_latency cycles. A store to a line other cores hold waits
+ * inv_latency cycles for its upgrade before it can be written.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "common.h"
+#include "coh.h"
+
+enum prefetch_policy {
+        PREFETCH_NONE,
+        PREFETCH_NEXT_LINE,
+        PREFETCH_STRIDE,
+        PREFETCH_STREAM,
+        NB_PREFETCHERS
+};
+
+struct cache_param {
+        int size;               // Bytes, 0 disables the cache: every access takes the miss latency
+        int ways;
+        int line_size;          // Bytes, power of 2
+        int hit_latency;
+        int miss_latency;       // Cycles to get a line from the next level
+        int nb_mshr;            // Lines on their way at once, 0 is unlimited
+        enum prefetch_policy prefetch;
+        int degree;             // Lines fetched by a prefetch trigger
+        int distance;           // How far ahead of the access the prefetches start
+        enum coh_protocol coherence;
+        int c2c_latency;        // Cycles to get a line from the cache of another core
+        int inv_latency;        // Cycles to invalidate the other copies of a line
+        int core;               // Requester id in the directory
+};
+
+struct cache_stats {
+        uint64_t loads;
+        uint64_t stores;
+        uint64_t misses;        // Demand accesses that had to fetch the line
+        uint64_t fills;         // Lines requested from the next level by the demand accesses
+        uint64_t merges;        // Secondary misses to a line already on its way
+        uint64_t mshr_stalls;   // Demand misses refused because every MSHR was busy
+        uint64_t pf_issued;     // Lines requested from the next level by the prefetcher
+        uint64_t pf_useful;     // Prefetched lines hit once their fill was done
+        uint64_t pf_late;       // Prefetched lines hit while their fill was still on the way
+        uint64_t pf_useless;    // Prefetched lines evicted or dropped without being used
+        uint64_t pf_dropped;    // Prefetches that found every MSHR busy
+        uint64_t coh_c2c;       // Lines sent by the cache of another core
+        uint64_t coh_upgrades;  // Stores that had to get the write permission
+        uint64_t coh_invals;    // Copies invalidated in the other cores by the upgrades
+        uint64_t coh_snooped;   // Lines of this core invalidated by the other cores
+        uint64_t coh_stalls;    // Cycles stores waited for their upgrade
+};
+
+int cache_create(const struct cache_param *p);
+
+void cache_destroy(void);
+
+// Advances the clock of the cache by one cycle
+void cache_tick(void);
+
+/* \fn cache_load
+ * \param addr Address of the load
+ * \param pc Address of the load instruction, trains the stride prefetcher
+ * \return Cycles before the data is available, -1 if the load misses and
+ *         every MSHR is busy
+ */
+int cache_load(uint32_t addr, uint32_t pc);
+
+// Write allocate, the store is post commit and doesn't wait for the fill
+// Returns 0 if the store misses and every MSHR is busy, or while it waits
+// for the write permission
+int cache_store(uint32_t addr, uint32_t pc);
+
+// Far atomic, performed at the memory. The copy of the line is dropped and
+// in a cluster every other copy is invalidated
+void cache_atomic(uint32_t addr);
+
+// Applies the invalidations and downgrades of the other cores, at the end
+// of a quantum
+void cache_sync(void);
+
+void cache_get_stats(struct cache_stats *s);
+
+extern const char *prefetch_names[NB_PREFETCHERS];
+
+#endif
@@ -0,0 +1,177 @@
+#include "coh.h"
+#include "mem.h"
+
+const char *coh_names[NB_COH_PROTOCOLS] = {
+        [COH_NONE] = "none",
+        [COH_MSI]  = "msi",
+        [COH_MESI] = "mesi",
+};
+
+
+// Growable list of line messages, requests or snoops of a core
+struct coh_log {
+        struct coh_msg {
+                uint32_t ln;
+                uint8_t type;
+        } *buf;
+        int nb;
+        int size;
+        int pos;        // Next snoop to hand out
+};
+
+static struct coh {
+        int nb_cores;
+        int nb_lines;
+        struct coh_dir {
+                uint32_t sharers;
+                int8_t owner;
+        } *dir;
+
+        struct coh_log req[MEM_MAX_CORES];
+        struct coh_log snoop[MEM_MAX_CORES];
+} coh = {0};
+
+
+static void log_push(struct coh_log *l, uint32_t ln, uint8_t type) {
+        if (l->nb == l->size) {
+                int size = l->size ? 2 * l->size : 256;
+                struct coh_msg *buf = realloc(l->buf, sizeof(*buf) * size);
+
+                // Out of memory, the message is lost
+                if (!buf)
+                        return;
+
+                l->buf = buf;
+                l->size = size;
+        }
+
+        l->buf[l->nb++] = (struct coh_msg) {ln, type};
+}
+
+
+static struct coh_dir *entry(uint32_t ln) {
+        return &coh.dir[ln % coh.nb_lines];
+}
+
+
+int coh_create(int nb_cores, int mem_size, int line_size) {
+        coh_destroy();
+
+        if (nb_cores < 1 || nb_cores > MEM_MAX_CORES || line_size < 4 || mem_size < line_size)
+                return EINVAL;
+
+        coh.nb_lines = mem_size / line_size;
+        coh.dir = malloc(sizeof(*coh.dir) * coh.nb_lines);
+
+        if (!coh.dir)
+                return ENOMEM;
+
+        for (int i = 0; i < coh.nb_lines; i++)
+                coh.dir[i] = (struct coh_dir) {.sharers = 0, .owner = -1};
+
+        coh.nb_cores = nb_cores;
+
+        return 0;
+}
+
+
+void coh_destroy(void) {
+        for (int i = 0; i < MEM_MAX_CORES; i++) {
+                if (coh.req[i].buf)
+                        free(coh.req[i].buf);
+                if (coh.snoop[i].buf)
+                        free(coh.snoop[i].buf);
+        }
+
+        if (coh.dir)
+                free(coh.dir);
+
+        coh = (struct coh) {0};
+}
+
+
+bool coh_enabled(void) {
+        return coh.nb_cores != 0;
+}
+
+
+uint32_t coh_sharers(uint32_t ln) {
+        return coh.nb_cores ? entry(ln)->sharers : 0;
+}
+
+
+int coh_owner(uint32_t ln) {
+        return coh.nb_cores ? entry(ln)->owner : -1;
+}
+
+
+void coh_request(int core, uint32_t ln, enum coh_request r) {
+        if (coh.nb_cores)
+                log_push(&coh.req[core], ln, r);
+}
+
+
+void coh_apply(void) {
+        for (int c = 0; c < coh.nb_cores; c++) {
+                for (int i = 0; i < coh.req[c].nb; i++) {
+                        struct coh_msg *m = &coh.req[c].buf[i];
+                        struct coh_dir *d = entry(m->ln);
+                        uint32_t others = d->sharers & ~(1u << c);
+
+                        switch (m->type) {
+                                case COH_READ_EXCL:
+                                        // Another core got a copy in the same quantum
+                                        if (others) {
+                                                log_push(&coh.snoop[c], m->ln, COH_DOWNGRADE);
+                                                m->type = COH_READ;
+                                        }
+                                        // fall through
+                                case COH_READ:
+                                        if (d->owner >= 0 && d->owner != c)
+                                                log_push(&coh.snoop[d->owner], m->ln, COH_DOWNGRADE);
+                                        d->sharers |= 1u << c;
+                                        d->owner = m->type == COH_READ_EXCL ? c : -1;
+                                        break;
+                                case COH_WRITE:
+                                        for (int s = 0; s < coh.nb_cores; s++)
+                                                if (others & (1u << s))
+                                                        log_push(&coh.snoop[s], m->ln, COH_INVALIDATE);
+                                        d->sharers = 1u << c;
+                                        d->owner = c;
+                                        break;
+                                case COH_EVICT:
+                                        d->sharers &= ~(1u << c);
+                                        if (d->owner == c)
+                                                d->owner = -1;
+                                        break;
+                                case COH_ATOMIC:
+                                        for (int s = 0; s < coh.nb_cores; s++)
+                                                if (others & (1u << s))
+                                                        log_push(&coh.snoop[s], m->ln, COH_INVALIDATE);
+                                        d->sharers = 0;
+                                        d->owner = -1;
+                                        break;
+                        }
+                }
+        }
+}
+
+
+int coh_snoop(int core, uint32_t *ln, enum coh_snoop *s) {
+        struct coh_log *l = &coh.snoop[core];
+
+        if (!coh.nb_cores)
+                return 0;
+
+        if (l->pos == l->nb) {
+                l->nb = l->pos = 0;
+                coh.req[core].nb = 0;
+                return 0;
+        }
+
+        *ln = l->buf[l->pos].ln;
+        *s = l->buf[l->pos].type;
+        l->pos++;
+
+        return 1;
+}
@@ -0,0 +1,62 @@
+/* COHERENCE
+ * Directory of the L1D lines of a cluster, MSI or MESI. For every line the
+ * directory keeps the cores holding a copy and the core allowed to write
+ * it (E or M). It is read only while the cores simulate a quantum: a core
+ * decides the state of its own copies from what the directory says and
+ * logs its requests. At the end of the quantum the requests of every core
+ * are applied in core order, which sends the invalidations and downgrades
+ * each core applies to its L1D before the next quantum.
+ */
+#ifndef __COH_H__
+#define __COH_H__
+
+#include "common.h"
+
+enum coh_protocol {
+        COH_NONE,       // Caches are not kept coherent
+        COH_MSI,
+        COH_MESI,       // A line no other core holds is granted exclusive
+        NB_COH_PROTOCOLS
+};
+
+enum coh_request {
+        COH_READ,       // Copy granted shared
+        COH_READ_EXCL,  // Copy granted exclusive, no other core had it
+        COH_WRITE,      // Write permission, every other copy is invalidated
+        COH_EVICT,      // Copy dropped
+        COH_ATOMIC      // Atomic performed at the memory, every copy is invalidated
+};
+
+enum coh_snoop {
+        COH_INVALIDATE,
+        COH_DOWNGRADE   // E or M copy goes back to S
+};
+
+int coh_create(int nb_cores, int mem_size, int line_size);
+
+void coh_destroy(void);
+
+// Directory as of the start of the quantum, false without a directory
+bool coh_enabled(void);
+
+// Cores with a copy of line ln, and the core with write permission or -1
+uint32_t coh_sharers(uint32_t ln);
+int coh_owner(uint32_t ln);
+
+void coh_request(int core, uint32_t ln, enum coh_request r);
+
+/* \fn coh_apply
+ * \brief Applies the requests of every core, called by a single core
+ *        once all of them are done with the quantum
+ */
+void coh_apply(void);
+
+/* \fn coh_snoop
+ * \brief Next snoop of a core, once the requests are applied
+ * \return 0 once the core has none left, its requests are then cleared
+ */
+int coh_snoop(int core, uint32_t *ln, enum coh_snoop *s);
+
+extern const char *coh_names[NB_COH_PROTOCOLS];
+
+#endif
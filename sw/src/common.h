@@ -10,4 +10,34 @@
 
 #define IS_LITTLE_ENDIAN (*(uint8_t *)&(uint16_t){1})
 
+// Width of the tags naming ROB entries and physical registers, set at
+// compile time with -DTAG_BITS=8/16/32
+#ifndef TAG_BITS
+#define TAG_BITS 16
+#endif
+
+#if TAG_BITS == 8
+typedef uint8_t tag_t;
+#elif TAG_BITS == 16
+typedef uint16_t tag_t;
+#elif TAG_BITS == 32
+typedef uint32_t tag_t;
+#else
+#error "TAG_BITS must be 8, 16 or 32"
+#endif
+
+// Number of distinct tags
+#define TAG_COUNT ((uint64_t)1 << TAG_BITS)
+
+// State of a core, every core of a cluster is simulated by its own thread
+#define CORE_LOCAL _Thread_local
+
+// Number of bits needed to address n elements
+static inline int clog2(int n) {
+        int b = 0;
+        while ((1 << b) < n)
+                b++;
+        return b;
+}
+
 #endif
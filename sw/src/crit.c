@@ -0,0 +1,248 @@
+#include "crit.h"
+#include <inttypes.h>
+
+static const char *edge_names[NB_CRIT_EDGES] = {
+        [CRIT_FETCH]      = "fetch",
+        [CRIT_MISPREDICT] = "mispredict",
+        [CRIT_ROB]        = "rob",
+        [CRIT_EXB]        = "exb",
+        [CRIT_REG]        = "reg",
+        [CRIT_ISSUE]      = "issue",
+        [CRIT_EXECUTE]    = "execute",
+        [CRIT_CDB]        = "cdb",
+        [CRIT_MEMORY]     = "memory",
+        [CRIT_COMMIT]     = "commit",
+        [CRIT_RETIRE]     = "retire",
+};
+
+static const char *edge_hints[NB_CRIT_EDGES] = {
+        [CRIT_FETCH]      = "dispatch width, taken branches",
+        [CRIT_MISPREDICT] = "branch resolution and recovery",
+        [CRIT_ROB]        = "ROB, load/store buffer or PRF entries",
+        [CRIT_EXB]        = "EXB entries",
+        [CRIT_REG]        = "chains of dependent operands",
+        [CRIT_ISSUE]      = "units of the pool, select policy",
+        [CRIT_EXECUTE]    = "latency of the units",
+        [CRIT_CDB]        = "CDB lanes, arbitration",
+        [CRIT_MEMORY]     = "cache, MSHRs, memory dependences",
+        [CRIT_COMMIT]     = "commit of a completed op",
+        [CRIT_RETIRE]     = "dispatch and commit width, store buffer",
+};
+
+// Cycles and edges of the path ending at an event
+struct crit_node {
+        uint64_t t;                             // Cycle of the event
+        uint64_t cycles[NB_CRIT_EDGES];
+        uint64_t edges[NB_CRIT_EDGES];
+};
+
+static CORE_LOCAL struct crit {
+        int rob_size;
+        struct crit_rob {
+                struct crit_node node;  // Last event of the instruction
+                uint64_t issued;
+                int latency;            // Of the unit it issued to
+                bool memory;
+        } *rob;
+
+        // Last events of the core
+        struct crit_node dispatch, issue, commit, redirect;
+        enum crit_edge block;   // What the next dispatch waits on
+
+        struct crit_node total; // Regions stopped so far
+} crit = {0};
+
+
+void crit_destroy(void) {
+        if (crit.rob)
+                free(crit.rob);
+
+        crit = (struct crit) {0};
+}
+
+
+int crit_create(int rob_size) {
+        crit = (struct crit) {
+                .rob_size = rob_size,
+                .rob = calloc(rob_size, sizeof(*crit.rob)),
+        };
+
+        if (!crit.rob) {
+                crit_destroy();
+                return ENOMEM;
+        }
+
+        // The path starts at the reset, the cycle before the first dispatch,
+        // so that it spans every cycle of the run like those of a region
+        crit_start(0);
+        crit.dispatch.cycles[CRIT_FETCH] = crit.dispatch.edges[CRIT_FETCH] = 1;
+        crit.issue = crit.commit = crit.redirect = crit.dispatch;
+
+        return 0;
+}
+
+
+void crit_start(uint64_t cycle) {
+        crit.dispatch = (struct crit_node) {.t = cycle};
+        crit.issue = crit.dispatch;
+        crit.commit = crit.dispatch;
+        crit.redirect = crit.dispatch;
+        crit.block = CRIT_FETCH;
+}
+
+
+void crit_stop(void) {
+        for (int e = 0; e < NB_CRIT_EDGES; e++) {
+                crit.total.cycles[e] += crit.commit.cycles[e];
+                crit.total.edges[e] += crit.commit.edges[e];
+        }
+
+        crit_start(crit.commit.t);
+}
+
+
+// The event at cycle t follows from, through an edge of type e
+static void follow(struct crit_node *n, const struct crit_node *from, enum crit_edge e, uint64_t t) {
+        struct crit_node p = *from;
+
+        p.cycles[e] += t - p.t;
+        p.edges[e]++;
+        p.t = t;
+
+        *n = p;
+}
+
+
+void crit_block(enum crit_edge e) {
+        crit.block = e;
+}
+
+
+void crit_dispatch(tag_t rob, uint64_t cycle) {
+        const struct crit_node *from = &crit.dispatch;
+        enum crit_edge e = CRIT_FETCH;
+
+        // The event that unblocked the dispatch, if it came after the
+        // previous dispatch
+        if (crit.block == CRIT_ROB && crit.commit.t >= from->t)
+                from = &crit.commit;
+        else if (crit.block == CRIT_EXB && crit.issue.t >= from->t)
+                from = &crit.issue;
+        else if (crit.block == CRIT_MISPREDICT && crit.redirect.t >= from->t)
+                from = &crit.redirect;
+        if (from != &crit.dispatch)
+                e = crit.block;
+
+        struct crit_rob *r = &crit.rob[rob];
+
+        follow(&r->node, from, e, cycle);
+        crit.dispatch = r->node;
+        crit.block = CRIT_FETCH;
+
+        // The second load of a pair is never issued, it waits on memory
+        // from its dispatch
+        r->issued = cycle;
+        r->latency = 0;
+        r->memory = true;
+}
+
+
+void crit_operand(tag_t rob, tag_t producer, uint64_t cycle) {
+        struct crit_node *n = &crit.rob[rob].node;
+        const struct crit_node *p = &crit.rob[producer].node;
+
+        if (p->t >= n->t)
+                follow(n, p, CRIT_REG, cycle);
+}
+
+
+void crit_issue(tag_t rob, uint64_t cycle, int latency, bool memory) {
+        struct crit_rob *r = &crit.rob[rob];
+
+        follow(&r->node, &r->node, CRIT_ISSUE, cycle);
+        r->issued = cycle;
+        r->latency = latency;
+        r->memory = memory;
+
+        crit.issue = r->node;
+}
+
+
+void crit_complete(tag_t rob, uint64_t cycle) {
+        struct crit_rob *r = &crit.rob[rob];
+
+        if (r->memory) {
+                follow(&r->node, &r->node, CRIT_MEMORY, cycle);
+                return;
+        }
+
+        // The result can take a lane the cycle after the unit is done, it
+        // waits if the arbiter gives the lanes to others
+        uint64_t done = r->issued + r->latency + 1;
+
+        if (done > cycle)
+                done = cycle;
+        if (done < r->node.t)
+                done = r->node.t;
+
+        follow(&r->node, &r->node, CRIT_EXECUTE, done);
+        if (cycle > done)
+                follow(&r->node, &r->node, CRIT_CDB, cycle);
+}
+
+
+void crit_redirect(tag_t rob, uint64_t cycle) {
+        struct crit_rob *r = &crit.rob[rob];
+
+        follow(&crit.redirect, &r->node, r->memory ? CRIT_MEMORY : CRIT_EXECUTE, cycle);
+        crit.block = CRIT_MISPREDICT;
+}
+
+
+void crit_commit(tag_t rob, uint64_t cycle) {
+        const struct crit_node *from = &crit.rob[rob].node;
+        enum crit_edge e = CRIT_COMMIT;
+
+        if (crit.commit.t > from->t) {
+                from = &crit.commit;
+                e = CRIT_RETIRE;
+        }
+
+        follow(&crit.commit, from, e, cycle);
+}
+
+
+void crit_report(FILE *f) {
+        uint64_t cycles = 0, edges = 0;
+        int order[NB_CRIT_EDGES];
+
+        for (int e = 0; e < NB_CRIT_EDGES; e++) {
+                cycles += crit.total.cycles[e];
+                edges += crit.total.edges[e];
+                order[e] = e;
+        }
+
+        // Most cycles first
+        for (int i = 1; i < NB_CRIT_EDGES; i++) {
+                int e = order[i], j = i - 1;
+
+                while (j >= 0 && crit.total.cycles[order[j]] < crit.total.cycles[e]) {
+                        order[j + 1] = order[j];
+                        j--;
+                }
+                order[j + 1] = e;
+        }
+
+        fprintf(f, "critical  : %" PRIu64 " cycles, %" PRIu64 " edges\n", cycles, edges);
+        fprintf(f, "%12s %12s %7s %12s  %s\n", "edge", "cycles", "%", "edges", "waits on");
+
+        for (int i = 0; i < NB_CRIT_EDGES; i++) {
+                int e = order[i];
+
+                if (!crit.total.edges[e])
+                        continue;
+
+                fprintf(f, "%12s %12" PRIu64 " %6.2f%% %12" PRIu64 "  %s\n", edge_names[e], crit.total.cycles[e],
+                        cycles ? 100.0 * crit.total.cycles[e] / cycles : 0.0, crit.total.edges[e], edge_hints[e]);
+        }
+}
@@ -0,0 +1,71 @@
+/* CRITICAL PATH
+ * Longest path of the dynamic dependence graph, followed online. Every
+ * instruction is dispatched (D), becomes ready (R), issues (I), completes
+ * (E) and commits (C). Each event keeps its last arriving edge: the
+ * dependence that was resolved last and made it happen when it did. The
+ * cycles of a node are those of its predecessor plus the weight of that
+ * edge, counted per edge type. The path ending at the last commit then
+ * tells which resource the program waits on: ALUs and select for issue,
+ * CDB lanes, the ROB or EXB capacity, the memory or the producers of the
+ * operands.
+ *
+ * Only the nodes of the instructions in flight are kept, indexed by ROB
+ * entry, the memory doesn't grow with the length of the program.
+ */
+#ifndef __CRIT_H__
+#define __CRIT_H__
+
+#include "common.h"
+#include <stdio.h>
+
+enum crit_edge {
+        CRIT_FETCH,             // D -> D, in order dispatch and the end of the fetch groups
+        CRIT_MISPREDICT,        // Resolution of a mispredict or an ordering violation -> D
+        CRIT_ROB,               // C -> D, a commit frees a ROB, LSQ or PRF entry
+        CRIT_EXB,               // I -> D, an issue frees an EXB entry
+        CRIT_REG,               // E -> R, the producer of an operand
+        CRIT_ISSUE,             // R -> I, ready op waiting for a unit
+        CRIT_EXECUTE,           // I -> E, latency of the unit
+        CRIT_CDB,               // I -> E, result waiting for a CDB lane
+        CRIT_MEMORY,            // I -> E, address to data of a load, store or atomic
+        CRIT_COMMIT,            // E -> C
+        CRIT_RETIRE,            // C -> C, in order commit
+        NB_CRIT_EDGES
+};
+
+int crit_create(int rob_size);
+
+void crit_destroy(void);
+
+// The path starts at cycle, at reset and on ROI_BEGIN
+void crit_start(uint64_t cycle);
+
+// The path up to the last commit is added to the report, on ROI_END
+void crit_stop(void);
+
+// Dispatch stopped, the next one waits on edge e: CRIT_ROB or CRIT_EXB
+void crit_block(enum crit_edge e);
+
+void crit_dispatch(tag_t rob, uint64_t cycle);
+
+// The op of a ROB entry captured an operand produced by another
+void crit_operand(tag_t rob, tag_t producer, uint64_t cycle);
+
+// Issued to a unit of latency cycles, memory for the AGU of a load or store
+void crit_issue(tag_t rob, uint64_t cycle, int latency, bool memory);
+
+// Result on the CDB, or done without a result
+void crit_complete(tag_t rob, uint64_t cycle);
+
+// A mispredicted branch or a violating load redirects the frontend
+void crit_redirect(tag_t rob, uint64_t cycle);
+
+void crit_commit(tag_t rob, uint64_t cycle);
+
+/* \fn crit_report
+ * \brief Prints the cycles and the edges of the critical path per edge
+ *        type, most cycles first
+ */
+void crit_report(FILE *f);
+
+#endif
@@ -0,0 +1,131 @@
+#include "csr.h"
+
+const char *event_names[NB_EVENTS] = {
+        [EVENT_NONE]         = "none",
+        [EVENT_CYCLES]       = "cycles",
+        [EVENT_INSTRET]      = "instret",
+        [EVENT_BRANCHES]     = "branches",
+        [EVENT_MISPREDICTS]  = "mispredicts",
+        [EVENT_SQUASHED]     = "squashed",
+        [EVENT_RECOVERY]     = "recovery",
+        [EVENT_ROB_FULL]     = "rob-full",
+        [EVENT_EXB_FULL]     = "exb-full",
+        [EVENT_LSQ_FULL]     = "lsq-full",
+        [EVENT_PRF_FULL]     = "prf-full",
+        [EVENT_CDB_STALLS]   = "cdb-stalls",
+        [EVENT_L1D_LOADS]    = "l1d-loads",
+        [EVENT_L1D_STORES]   = "l1d-stores",
+        [EVENT_L1D_MISSES]   = "l1d-misses",
+        [EVENT_STORE_STALLS] = "store-stalls",
+        [EVENT_VIOLATIONS]   = "violations",
+        [EVENT_ATOMICS]      = "atomics",
+        [EVENT_SC_FAILURES]  = "sc-failures",
+};
+
+
+static CORE_LOCAL struct csr {
+        uint64_t offset[CSR_NB_COUNTERS];       // Counter value less its event total
+        uint64_t frozen[CSR_NB_COUNTERS];       // Value of an inhibited counter
+        uint32_t event[CSR_NB_COUNTERS];        // Event counted, 1 is the time and counts nothing
+        uint32_t inhibit;
+        uint32_t hart;
+} csr = {0};
+
+
+void csr_init(int hart) {
+        csr = (struct csr) {0};
+
+        csr.hart = hart;
+        csr.event[0] = EVENT_CYCLES;
+        csr.event[2] = EVENT_INSTRET;
+}
+
+
+static uint64_t total(int i, const uint64_t *events) {
+        return csr.event[i] < NB_EVENTS ? events[csr.event[i]] : 0;
+}
+
+
+static uint64_t counter(int i, const uint64_t *events) {
+        if (csr.inhibit & (1u << i))
+                return csr.frozen[i];
+
+        return csr.offset[i] + total(i, events);
+}
+
+
+static void set_counter(int i, uint64_t v, const uint64_t *events) {
+        csr.frozen[i] = v;
+        csr.offset[i] = v - total(i, events);
+}
+
+
+int csr_access(uint16_t addr, uint8_t f3, uint32_t src, bool write, const uint64_t *events, uint32_t *old) {
+        int i = addr & 0x1F;
+        bool high = addr & 0x80;
+        uint16_t base = addr & ~0x9F;
+        uint64_t v = 0;
+        uint32_t w;
+
+        if (addr == CSR_MHARTID) {
+                *old = csr.hart;
+                return 0;
+        }
+
+        // The user counters are read only shadows, time reads the cycles
+        if (base == CSR_CYCLE) {
+                v = counter(i == 1 ? 0 : i, events);
+                *old = high ? v >> 32 : v;
+                return 0;
+        }
+
+        // Counter 1 is time, it has no machine counter nor event
+        if ((base != CSR_MCYCLE && (base != CSR_MHPMEVENT || high)) || i == 1 || (base == CSR_MHPMEVENT && i == 2)) {
+                *old = 0;
+                return -1;
+        }
+
+        if (base == CSR_MCYCLE) {
+                v = counter(i, events);
+                *old = high ? v >> 32 : v;
+        } else {
+                *old = i == 0 ? csr.inhibit : csr.event[i];
+        }
+
+        // A plain read leaves the counter running
+        if (!write)
+                return 0;
+
+        switch (f3 & 0x3) {
+                case 1:  w = src;           break;
+                case 2:  w = *old | src;    break;
+                default: w = *old & ~src;   break;
+        }
+
+        if (base == CSR_MCYCLE) {
+                v = high ? (v & 0xFFFFFFFF) | (uint64_t)w << 32 : (v & ~0xFFFFFFFFull) | w;
+
+                // The write takes effect after the access itself retires
+                if (csr.event[i] == EVENT_INSTRET && !(csr.inhibit & (1u << i)))
+                        v--;
+                set_counter(i, v, events);
+        } else if (i == 0) {
+                // Counters keep their value while inhibited
+                for (int j = 0; j < CSR_NB_COUNTERS; j++) {
+                        uint32_t b = 1u << j;
+
+                        if ((w & b) && !(csr.inhibit & b))
+                                csr.frozen[j] = counter(j, events);
+                        else if (!(w & b) && (csr.inhibit & b))
+                                csr.offset[j] = csr.frozen[j] - total(j, events);
+                }
+                csr.inhibit = w & ~0x2u;
+        } else {
+                // The count goes on from its value with the new event
+                v = counter(i, events);
+                csr.event[i] = w;
+                set_counter(i, v, events);
+        }
+
+        return 0;
+}
@@ -0,0 +1,68 @@
+/* CSR
+ * Zicsr counters of a core: mcycle, minstret and the hpm counters 3 to 31
+ * with their mhpmevent selectors, mcountinhibit and the read only user
+ * shadows. A counter is an offset on an event total of the engine, the
+ * engine passes the totals of the cycle the access executes in.
+ */
+#ifndef __CSR_H__
+#define __CSR_H__
+
+#include "common.h"
+
+// Addresses
+#define CSR_MCOUNTINHIBIT       0x320
+#define CSR_MHPMEVENT           0x320   // mhpmevent3 is at 0x323
+#define CSR_MCYCLE              0xB00
+#define CSR_MINSTRET            0xB02
+#define CSR_MCYCLEH             0xB80
+#define CSR_CYCLE               0xC00
+#define CSR_TIME                0xC01
+#define CSR_INSTRET             0xC02
+#define CSR_CYCLEH              0xC80
+#define CSR_MHARTID             0xF14
+
+#define CSR_NB_COUNTERS         32
+
+// Flag of the engine op next to funct3, the access writes the CSR
+#define CSR_WRITE               0x8
+
+// Values of mhpmevent
+enum csr_event {
+        EVENT_NONE,             // The counter doesn't count
+        EVENT_CYCLES,
+        EVENT_INSTRET,
+        EVENT_BRANCHES,         // Branches and JALR dispatched
+        EVENT_MISPREDICTS,
+        EVENT_SQUASHED,         // Wrong path ops removed from the ROB
+        EVENT_RECOVERY,         // Cycles the frontend waited on a recovery
+        EVENT_ROB_FULL,         // Cycles dispatch stopped on a full ROB
+        EVENT_EXB_FULL,         // ... on a full execution buffer
+        EVENT_LSQ_FULL,         // ... on a full load or store buffer
+        EVENT_PRF_FULL,         // ... without a free physical register
+        EVENT_CDB_STALLS,       // Results held back by the CDB arbiter
+        EVENT_L1D_LOADS,
+        EVENT_L1D_STORES,
+        EVENT_L1D_MISSES,
+        EVENT_STORE_STALLS,     // Commit cycles lost to a store
+        EVENT_VIOLATIONS,       // Memory ordering violations
+        EVENT_ATOMICS,
+        EVENT_SC_FAILURES,
+        NB_EVENTS
+};
+
+// Resets the counters of a core
+void csr_init(int hart);
+
+/* \fn csr_access
+ * \brief Executes a CSR instruction
+ * \param f3 funct3 of the instruction, the immediate forms pass zimm in src
+ * \param write CSRRW, or CSRRS/CSRRC with rs1 or zimm not 0
+ * \param events Totals of every event, indexed by enum csr_event, 0 for EVENT_NONE
+ * \param old Value of the CSR before the access
+ * \return -1 if the CSR doesn't exist, it then reads 0 and ignores writes
+ */
+int csr_access(uint16_t addr, uint8_t f3, uint32_t src, bool write, const uint64_t *events, uint32_t *old);
+
+extern const char *event_names[NB_EVENTS];
+
+#endif
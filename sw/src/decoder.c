@@ -20,6 +20,7 @@ struct inst_field decode(uint32_t instruction) {
 
         switch(di.opcode) {
                 case OP_OP:
+                case OP_AMO:
                         format = 'R';
                         break;
 
@@ -54,7 +55,9 @@ struct inst_field decode(uint32_t instruction) {
         }
 
         //MAIN DECODER
-        di.rd = (instruction >> OFFSET_RD) & MASK_REG;
+        if (format != 'S' && format != 'B')
+                di.rd = (instruction >> OFFSET_RD) & MASK_REG;
+
         switch(format) {
                 case 'R':
                         di.rs1 = (instruction >> OFFSET_RS1) & MASK_REG;
@@ -65,25 +68,27 @@ struct inst_field decode(uint32_t instruction) {
                 case 'I':
                         di.rs1 = (instruction >> OFFSET_RS1) & MASK_REG;
                         di.funct3 = (instruction >> OFFSET_FUNCT3) & MASK_FUNCT3;
-                        di.immediate = (instruction >> OFFSET_I_IMM);
+                        di.immediate = (int32_t)instruction >> OFFSET_I_IMM;
                         break;
                 case 'S':
                         di.rs1 = (instruction >> OFFSET_RS1) & MASK_REG;
                         di.rs2 = (instruction >> OFFSET_RS2) & MASK_REG;
-                        //IMM
+                        di.funct3 = (instruction >> OFFSET_FUNCT3) & MASK_FUNCT3;
+                        di.immediate = ((int32_t)(instruction & 0xFE000000) >> 20) | ((instruction >> OFFSET_RD) & 0x1F);
                         break;
                 case 'B':
                         di.rs1 = (instruction >> OFFSET_RS1) & MASK_REG;
                         di.rs2 = (instruction >> OFFSET_RS2) & MASK_REG;
                         di.funct3 = (instruction >> OFFSET_FUNCT3) & MASK_FUNCT3;
-                        di.immediate = (instruction >> 24) | (instruction >> 7 & 0x1 << 11) | (instruction >> 25 & 0x3F << 5) | (instruction >> 8 & 0xF << 1);
+                        di.immediate = ((instruction & 0x80000000) ? 0xFFFFF000 : 0) | (((instruction >> 7) & 0x1) << 11)
+                                | (((instruction >> 25) & 0x3F) << 5) | (((instruction >> 8) & 0xF) << 1);
                         break;
                 case 'U':
                         di.immediate = instruction & MASK_IMM_U;
                         break;
                 case 'J':
-                        //FIXME
-                        di.immediate = (instruction >> 11) | (instruction & 0x000FF000) | (instruction & 0x00100000) & (instruction & 0x0FE00000);
+                        di.immediate = ((instruction & 0x80000000) ? 0xFFF00000 : 0) | (instruction & 0x000FF000)
+                                | (((instruction >> 20) & 0x1) << 11) | (((instruction >> 21) & 0x3FF) << 1);
                         break;
         }
 
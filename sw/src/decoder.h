@@ -13,6 +13,7 @@
 // SYSTEM -> NONE
 // MISC_MEM
 // LUI -> OPTYPE, already ready
+// AMO -> R, address in rs1, funct5 = funct7 >> 2
 
 #define OP_OP       0b01100
 #define OP_JALR     0b11001
@@ -25,6 +26,7 @@
 #define OP_LOAD     0b00000
 #define OP_MISC_MEM 0b00011
 #define OP_SYSTEM   0b11100
+#define OP_AMO      0b01011
 
 
 struct inst_field {
@@ -0,0 +1,102 @@
+#include "disasm.h"
+#include "decoder.h"
+
+static const char *op_names[8]     = {"ADD", "SLL", "SLT", "SLTU", "XOR", "SRL", "OR", "AND"};
+static const char *mul_names[8]    = {"MUL", "MULH", "MULHSU", "MULHU", "DIV", "DIVU", "REM", "REMU"};
+static const char *imm_names[8]    = {"ADDI", "SLLI", "SLTI", "SLTIU", "XORI", "SRLI", "ORI", "ANDI"};
+static const char *load_names[8]   = {"LB", "LH", "LW", NULL, "LBU", "LHU"};
+static const char *store_names[8]  = {"SB", "SH", "SW"};
+static const char *branch_names[8] = {"BEQ", "BNE", NULL, NULL, "BLT", "BGE", "BLTU", "BGEU"};
+static const char *csr_names[8]    = {NULL, "CSRRW", "CSRRS", "CSRRC", NULL, "CSRRWI", "CSRRSI", "CSRRCI"};
+static const char *ordering[4]     = {"", ".RL", ".AQ", ".AQRL"};
+
+static const char *amo_names[32] = {
+        [FUNCT5_LR]      = "LR.W",
+        [FUNCT5_SC]      = "SC.W",
+        [FUNCT5_AMOSWAP] = "AMOSWAP.W",
+        [FUNCT5_AMOADD]  = "AMOADD.W",
+        [FUNCT5_AMOXOR]  = "AMOXOR.W",
+        [FUNCT5_AMOAND]  = "AMOAND.W",
+        [FUNCT5_AMOOR]   = "AMOOR.W",
+        [FUNCT5_AMOMIN]  = "AMOMIN.W",
+        [FUNCT5_AMOMAX]  = "AMOMAX.W",
+        [FUNCT5_AMOMINU] = "AMOMINU.W",
+        [FUNCT5_AMOMAXU] = "AMOMAXU.W",
+};
+
+
+// Hexadecimal on as many bytes as the value needs, like hexStr
+static int hex(char *s, uint32_t v) {
+        return sprintf(s, "%0*X", v <= 0xFF ? 2 : v <= 0xFFFF ? 4 : 8, v);
+}
+
+
+int disasm(uint32_t inst, uint32_t pc, char *s) {
+        struct inst_field i = decode(inst);
+        const char *name = NULL;
+        int n;
+
+        switch (i.opcode) {
+                case OP_OP:
+                        if (i.funct7 == 1)
+                                name = mul_names[i.funct3];
+                        else if (i.funct7 == FUNCT7_SUB && i.funct3 == FUNCT3_ADDSUB)
+                                name = "SUB";
+                        else if (i.funct7 == FUNCT7_SRA && i.funct3 == FUNCT3_SR)
+                                name = "SRA";
+                        else if (i.funct7 == 0)
+                                name = op_names[i.funct3];
+                        if (!name)
+                                break;
+                        return sprintf(s, "%s x%d x%d x%d", name, i.rd, i.rs1, i.rs2);
+                case OP_IMM:
+                        name = imm_names[i.funct3];
+                        if (i.funct3 == FUNCT3_SL || i.funct3 == FUNCT3_SR) {
+                                if (i.immediate & 0x400)
+                                        name = "SRAI";
+                                i.immediate &= 0x1F;
+                        }
+                        return sprintf(s, "%s x%d x%d %d", name, i.rd, i.rs1, i.immediate);
+                case OP_LOAD:
+                case OP_JALR:
+                        name = i.opcode == OP_JALR ? "JALR" : load_names[i.funct3];
+                        if (!name)
+                                break;
+                        return sprintf(s, "%s x%d x%d %d", name, i.rd, i.rs1, i.immediate);
+                case OP_STORE:
+                        if (!(name = store_names[i.funct3]))
+                                break;
+                        n = sprintf(s, "%s x%d 0x", name, i.rs2);
+                        n += hex(s + n, i.immediate);
+                        return n + sprintf(s + n, "(x%d)", i.rs1);
+                case OP_BRANCH:
+                        if (!(name = branch_names[i.funct3]))
+                                break;
+                        return sprintf(s, "%s x%d x%d %d", name, i.rs1, i.rs2, i.immediate);
+                case OP_LUI:
+                case OP_AUIPC:
+                        n = sprintf(s, "%s x%d 0x", i.opcode == OP_LUI ? "LUI" : "AUIPC", i.rd);
+                        return n + hex(s + n, (uint32_t)i.immediate >> 12);
+                case OP_JAL:
+                        n = sprintf(s, "JAL x%d 0x", i.rd);
+                        return n + hex(s + n, pc + i.immediate);
+                case OP_AMO:
+                        if (i.funct3 != FUNCT3_AMO_W || !(name = amo_names[i.funct7 >> 2]))
+                                break;
+                        if ((i.funct7 >> 2) == FUNCT5_LR)
+                                return sprintf(s, "%s%s x%d (x%d)", name, ordering[i.funct7 & 3], i.rd, i.rs1);
+                        return sprintf(s, "%s%s x%d x%d (x%d)", name, ordering[i.funct7 & 3], i.rd, i.rs2, i.rs1);
+                case OP_MISC_MEM:
+                        return sprintf(s, "FENCE");
+                case OP_SYSTEM:
+                        if (i.funct3 == FUNCT3_PRIV && (i.immediate == FUNCT12_ECALL || i.immediate == FUNCT12_EBREAK0))
+                                return sprintf(s, i.immediate == FUNCT12_ECALL ? "ECALL" : "EBREAK");
+                        if (!(name = csr_names[i.funct3]))
+                                break;
+                        // The immediate forms write zimm, in rs1
+                        return sprintf(s, "%s x%d 0x%03X %s%d", name, i.rd, i.immediate & 0xFFF,
+                                i.funct3 & 4 ? "" : "x", i.rs1);
+        }
+
+        return sprintf(s, "BAD INSTRUCTION");
+}
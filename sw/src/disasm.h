@@ -0,0 +1,21 @@
+/* DISASSEMBLY
+ * Text form of an RV32IMA_Zicsr instruction, in the format of
+ * buildInstString of the first simulator (ELE749_projet1-develop): the
+ * name in capitals followed by the registers and the immediate, for
+ * example ADD x12 x6 x7 or SW x5 0x08(x10).
+ */
+#ifndef __DISASM_H__
+#define __DISASM_H__
+
+#include "common.h"
+
+#define DISASM_SIZE     40      // Longest text with its terminator
+
+/* \fn disasm
+ * \param pc Address of the instruction, JAL shows its target
+ * \param s Text of at least DISASM_SIZE characters
+ * \return The length of the text
+ */
+int disasm(uint32_t inst, uint32_t pc, char *s);
+
+#endif
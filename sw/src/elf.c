@@ -1,8 +1,51 @@
 #include "elf.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Address sized field, 4 bytes in an ELF32 and 8 in an ELF64
+static uint64_t word(struct elf_file *f) {
+        uint64_t v = 0;
+
+        fread(&v, f->e.indent[EI_CLASS] == 0x01 ? 4 : 8, 1, f->f);
+
+        return v;
+}
+
+
+static int read_sections(struct elf_file *f) {
+        if (!f->e.shnum)
+                return 0;
+
+        if (!(f->sh = calloc(f->e.shnum, sizeof(*f->sh))))
+                return ENOMEM;
+
+        for (int i = 0; i < f->e.shnum; i++) {
+                struct elf_sheader *s = &f->sh[i];
+
+                if (fseek(f->f, f->e.shoff + (uint64_t)i * f->e.shentsize, SEEK_SET))
+                        return EINVAL;
+
+                fread(&s->name, 4, 1, f->f);
+                fread(&s->type, 4, 1, f->f);
+                s->flags = word(f);
+                s->addr = word(f);
+                s->offset = word(f);
+                s->size = word(f);
+                fread(&s->link, 4, 1, f->f);
+                fread(&s->info, 4, 1, f->f);
+                s->addralign = word(f);
+                s->entsize = word(f);
+        }
+
+        return ferror(f->f) ? EIO : 0;
+}
+
 
 int elf_open(const char *path, struct elf_file *f) {
         int err = 0;
 
+        *f = (struct elf_file) {0};
+
         // ELF Header
         f->f = fopen(path, "r");
         if(!f->f) return ENOENT;
@@ -29,31 +72,209 @@ int elf_open(const char *path, struct elf_file *f) {
         fread(&f->e.machine, 2, 1, f->f);
         fread(&f->e.version, 4, 1, f->f);
 
-        if(f->e.indent[EI_DATA] == 0x01) {
-
-        } else if (f->e.indent[EI_DATA] == 0x01) {
-
-        } else {
+        // Only little endian files are read, like the host
+        if(f->e.indent[EI_DATA] != 0x01 || (f->e.indent[EI_CLASS] != 0x01 && f->e.indent[EI_CLASS] != 0x02)) {
                 err = -2;
                 goto CLEANUP;
         }
 
+        f->e.entry = word(f);
+        f->e.phoff = word(f);
+        f->e.shoff = word(f);
+
         // Read the rest of the header
         fread(&f->e.flags, 1, 4 + 2 + 2 + 2 + 2 + 2 + 2, f->f);
 
-        // Program Header
-
         // Section Header
+        if ((err = read_sections(f)))
+                goto CLEANUP;
 
         return 0;
 
 CLEANUP:
-        fclose(f->f);
+        elf_close(f);
 
         return err;
 }
 
-int elf_map(struct elf_file *f) {
+
+int elf_close(struct elf_file *f) {
+        if (f->sh)
+                free(f->sh);
+        f->sh = NULL;
+
+        if (f->f)
+                fclose(f->f);
+        f->f = NULL;
+
         return 0;
 }
 
+
+// Reads the content of a section, NULL without memory
+static void *read_section(struct elf_file *f, const struct elf_sheader *s) {
+        void *data = malloc(s->size + 1);
+
+        if (!data)
+                return NULL;
+
+        if (fseek(f->f, s->offset, SEEK_SET) || fread(data, 1, s->size, f->f) != s->size) {
+                free(data);
+                return NULL;
+        }
+
+        // Terminates the last string of a string table
+        ((char *)data)[s->size] = 0;
+
+        return data;
+}
+
+
+int elf_load(struct elf_file *f, uint64_t size, int (*write)(int addr, void *data, size_t n)) {
+        int code = 0;
+
+        for (int i = 0; i < f->e.shnum; i++) {
+                const struct elf_sheader *s = &f->sh[i];
+                void *data;
+                int n;
+
+                if (s->type != SHT_PROGBITS || !(s->flags & SHF_ALLOC) || !s->size)
+                        continue;
+
+                // The code sections of an object file would all overwrite
+                // each other at 0, their relocations are not applied
+                if (f->e.type == ET_REL && !(s->flags & SHF_EXECINSTR))
+                        continue;
+                if (f->e.type == ET_REL && code++)
+                        return EINVAL;
+
+                if (s->addr > size || s->size > size - s->addr)
+                        return EFBIG;
+
+                if (!(data = read_section(f, s)))
+                        return ENOMEM;
+
+                n = write(s->addr, data, s->size);
+                free(data);
+
+                if ((uint64_t)n != s->size)
+                        return EFBIG;
+        }
+
+        return 0;
+}
+
+
+// By address, a function before a label at the same address
+static int compare(const void *a, const void *b) {
+        const struct elf_symbol *x = a, *y = b;
+
+        if (x->addr != y->addr)
+                return x->addr < y->addr ? -1 : 1;
+
+        return y->func - x->func;
+}
+
+
+int elf_symbols(struct elf_file *f, struct elf_symbol **sym, int *nb_sym) {
+        const struct elf_sheader *symtab = NULL;
+        uint8_t *tab = NULL;
+        char *str = NULL;
+        int n = 0, err = 0;
+
+        *sym = NULL;
+        *nb_sym = 0;
+
+        for (int i = 0; i < f->e.shnum && !symtab; i++)
+                if (f->sh[i].type == SHT_SYMTAB && f->sh[i].link < f->e.shnum)
+                        symtab = &f->sh[i];
+
+        if (!symtab || !symtab->entsize)
+                return -1;
+
+        int count = symtab->size / symtab->entsize;
+        const struct elf_sheader *strtab = &f->sh[symtab->link];
+
+        if (!(tab = read_section(f, symtab)) || !(str = read_section(f, strtab))
+                || !(*sym = calloc(count ? count : 1, sizeof(**sym)))) {
+                err = ENOMEM;
+                goto CLEANUP;
+        }
+
+        for (int i = 0; i < count; i++) {
+                const uint8_t *e = tab + (uint64_t)i * symtab->entsize;
+                uint32_t name, value, size;
+                uint16_t shndx;
+                uint8_t info;
+
+                // Fields are ordered differently in an ELF64
+                memcpy(&name, e, 4);
+                if (f->e.indent[EI_CLASS] == 0x01) {
+                        memcpy(&value, e + 4, 4);
+                        memcpy(&size, e + 8, 4);
+                        info = e[12];
+                        memcpy(&shndx, e + 14, 2);
+                } else {
+                        info = e[4];
+                        memcpy(&shndx, e + 6, 2);
+                        memcpy(&value, e + 8, 4);
+                        memcpy(&size, e + 16, 4);
+                }
+
+                // Functions and labels of the code, not the local labels of
+                // the assembler
+                uint8_t type = info & 0xF;
+                const char *s = name < strtab->size ? str + name : "";
+
+                if ((type != STT_FUNC && type != STT_NOTYPE) || shndx == SHN_UNDEF || shndx >= SHN_LORESERVE
+                        || shndx >= f->e.shnum || !(f->sh[shndx].flags & SHF_EXECINSTR)
+                        || !*s || *s == '$' || !strncmp(s, ".L", 2))
+                        continue;
+
+                if (!((*sym)[n].name = strdup(s))) {
+                        err = ENOMEM;
+                        goto CLEANUP;
+                }
+                (*sym)[n].addr = value;
+                (*sym)[n].size = type == STT_FUNC ? size : 0;
+                (*sym)[n].func = type == STT_FUNC;
+                n++;
+        }
+
+        qsort(*sym, n, sizeof(**sym), compare);
+
+        // One symbol per address
+        int k = 0;
+        for (int i = 0; i < n; i++) {
+                if (k && (*sym)[k - 1].addr == (*sym)[i].addr)
+                        free((*sym)[i].name);
+                else
+                        (*sym)[k++] = (*sym)[i];
+        }
+        n = k;
+
+CLEANUP:
+        if (tab)
+                free(tab);
+        if (str)
+                free(str);
+
+        if (err) {
+                elf_free_symbols(*sym, n);
+                *sym = NULL;
+                return err;
+        }
+
+        *nb_sym = n;
+
+        return 0;
+}
+
+
+void elf_free_symbols(struct elf_symbol *sym, int nb_sym) {
+        for (int i = 0; sym && i < nb_sym; i++)
+                free(sym[i].name);
+
+        if (sym)
+                free(sym);
+}
@@ -2,6 +2,7 @@
 #define __ELF_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <errno.h>
 
@@ -203,15 +204,54 @@ struct elf_sheader {
         uint64_t entsize;
 };
 
+#define ET_REL          0x1             // Object file, not linked
+#define ET_EXEC         0x2             // Executable, starts at e.entry
+
+#define STT_NOTYPE      0x0
+#define STT_OBJECT      0x1
+#define STT_FUNC        0x2
+#define STT_SECTION     0x3
+#define STT_FILE        0x4
+
+#define SHN_UNDEF       0x0
+#define SHN_LORESERVE   0xFF00
+
+struct elf_symbol {
+        uint32_t addr;
+        uint32_t size;          // 0 if unknown, the symbol then ends at the next one
+        bool func;              // Typed as a function, else a label of the code
+        char *name;
+};
+
 struct elf_file {
         struct elf_header e;
         struct elf_pheader p;
-        struct elf_sheader sh;
+        struct elf_sheader *sh; // Section headers, e.shnum of them
         FILE * f;
 };
 
+// Reads the header and the section headers of a little endian ELF32 or ELF64
 int elf_open(const char *path, struct elf_file *f);
 
 int elf_close(struct elf_file *f);
 
+/* \fn elf_load
+ * \brief Calls write for the content of every allocated section, at its
+ *        address. The sections of an object file all start at 0, only its
+ *        code is loaded like the .txt images made with objcopy -j .text
+ * \param size Bytes of memory, every section must fit below
+ * \return EFBIG if a section doesn't fit, EINVAL for an object file with
+ *         more than one code section, ENOMEM
+ */
+int elf_load(struct elf_file *f, uint64_t size, int (*write)(int addr, void *data, size_t n));
+
+/* \fn elf_symbols
+ * \brief Reads the functions and code labels of the symbol table, sorted by
+ *        address without duplicates. Free them with elf_free_symbols
+ * \return 0 or an error, -1 without a symbol table
+ */
+int elf_symbols(struct elf_file *f, struct elf_symbol **sym, int *nb_sym);
+
+void elf_free_symbols(struct elf_symbol *sym, int nb_sym);
+
 #endif
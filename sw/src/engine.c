@@ -3,63 +3,193 @@
  */
 #include "engine.h"
 
-static uint32_t PC = 0;
-static uint32_t instruction;
+static CORE_LOCAL uint32_t PC = 0;
+static CORE_LOCAL uint32_t next_pc = 0;    // Predicted address of the next instruction
+static CORE_LOCAL uint32_t instruction;
+static CORE_LOCAL uint32_t next_instruction;       // Instruction at PC + 4, candidate for fusion
+static CORE_LOCAL uint32_t fusion = 0;             // Whitelist of the fusion patterns
+
+// Dispatch group
+static CORE_LOCAL int dispatch_width = 1;
+static CORE_LOCAL uint64_t group_writes = 0;       // Scoreboard mask of the registers written by the group
+
+static CORE_LOCAL bool halt = false;
+
+// Decoupled frontend, the dispatch follows the trace of the functional
+// thread and stops on a misprediction since the wrong path is not in it
+static CORE_LOCAL enum frontend frontend = FRONTEND_INTEGRATED;
+static CORE_LOCAL struct func func;
+static CORE_LOCAL struct ring ring;
+static CORE_LOCAL bool trace_wait = false;         // Waiting for the redirect of a mispredicted branch
+static CORE_LOCAL const struct trace_inst *trace[2];      // Records at the head of the ring
+static CORE_LOCAL int trace_used;                  // Records consumed by the last dispatch
+static CORE_LOCAL struct engine_stats stats = {0};
+
+static CORE_LOCAL enum rename_mode rename_mode = RENAME_ROB;
+
+// Regions of interest, the counters of a region are the difference of two
+// snapshots of the statistics
+static CORE_LOCAL struct roi {
+        enum roi_mode mode;
+        bool inside;
+        bool fast;              // Fast-forwarding, the backend is empty
+        struct engine_stats start;      // Statistics when the region was entered
+        struct engine_stats total;      // Regions left so far
+        int nb_dumps;
+        struct engine_stats *dumps;
+        struct func ff;         // Functional model of the fast-forward, runs on the engine memory
+} roi = {0};
+
+static CORE_LOCAL bool profile = false;            // Cycles charged to the instruction addresses
+static CORE_LOCAL int hotspots = 0;                // Rows of the hotspot report
+static CORE_LOCAL enum prof_format functions = PROF_NONE;
+static CORE_LOCAL char folded[FILENAME_MAX];
+static CORE_LOCAL bool critical = false;            // Critical path of the dependence graph
 
 // ---
 // LOCAL STRUCT
 // ---
-static struct cdb {
+// Misprediction recovery
+static CORE_LOCAL struct recovery {
+        int rob_size;
+        int latency;            // Cycles to restore a checkpoint
+        int walk_width;         // ROB entries undone per cycle without a checkpoint
+        int stall;              // Cycles left before the frontend restarts
+
+        int nb_ckpt;
+        struct checkpoint {
+                tag_t rob;      // Branch owning the checkpoint
+                bool busy;
+        } *ckpt;
+} recovery = {0};
+
+// Top-down accounting of the dispatch slots
+static CORE_LOCAL struct topdown {
+        struct topdown_rob {
+                bool slot;      // Took a dispatch slot, the second load of a pair doesn't
+                bool mem;       // Load, store or atomic
+        } *rob;
+        enum slot_class stall;  // Why the last dispatch stopped
+        uint64_t halted;        // Slots lost behind a halt that may be on the wrong path
+} topdown = {0};
+
+
+static CORE_LOCAL struct cdb {
         int nb_lanes;
         int nb_active_lanes;
         struct cdb_data {
-                uint8_t qr;
+                tag_t qr;
+                tag_t rob;
                 int32_t result;
                 bool valid;
         } *lane;
+
+        // Arbiter, like hw/src/arbiter.vhd the initiators are the units
+        // followed by the LSU
+        enum cdb_policy policy;
+        bool lookahead;         // Initiators with a second value ready keep the bus
+        int nb_init;
+        int token;              // Last initiator granted, for round robin
+        bool *hold;             // Initiator was granted with its look-ahead set
+
+        int nb_req;
+        struct cdb_req {
+                int init;       // Initiator of the request
+                int load;       // Load buffer entry, -1 for a unit
+                tag_t rob;
+                int prio;       // Lowest value is granted first
+        } *req;
 } cdb = {0};
 
 
-static struct exu {
+static CORE_LOCAL struct exu {
         int nb_units;
         struct exu_data {
-                int32_t result;
-                uint8_t qr;
-                int cycle_left;
-                bool busy;
-                int capabilities; // TODO : Information on operations that the unit can do
+                enum unit_type type;    // Pool of the unit, operations it can execute
+                int interval_left;      // Cycles before the unit can accept a new op
+                int depth;              // Max number of ops in flight (pipeline stages)
+                int nb_ops;
+                struct exu_op {
+                        int32_t result;
+                        tag_t qr;
+                        tag_t rob;
+                        int lsq;        // LSU entry of a load/store (AGU)
+                        int lsq2;       // LSU entry of the second load of a pair
+                        bool wb;        // Result must be written back on the CDB
+                        bool store;
+                        bool branch;    // Branch or jump not resolved yet
+                        bool mispredict;
+                        uint32_t npc;   // Resolved address of the next instruction
+                        int cycle_left;
+                } *ops;                 // Ops in flight, oldest first
         } *units;
 
-        int *ready_list;
-        int nb_rdy;
+        struct exu_pool {
+                int first;              // Index of the first unit of the pool
+                int count;
+                int latency;
+                int interval;
 
-        int *done_list;
-        int nb_done;
+                int *ready_list;
+                int nb_rdy;
+        } pool[NB_UNIT_TYPES];
 } exu = {0};
 
 
-static struct exb {
+static CORE_LOCAL struct exb {
         int buf_size;
         int buf_cnt;
         struct exb_data {
                 uint16_t f10;   // Operation executed
+                uint8_t op;     // Opcode
+                enum unit_type type; // Pool that can execute the operation
+                uint32_t pc;
+                uint32_t npc;   // Predicted address of the next instruction
+                uint32_t onpc;  // Actual address of the next instruction, decoupled frontend
+                uint32_t addr;  // Actual address of a load or store, decoupled frontend
+                int32_t imm;    // Offset of a branch or jump
+                int fuse;       // Fusion pattern of the op, -1 if not fused
+                int lsq;        // LSU entry of a load/store
+                int lsq2;       // LSU entry of the second load of a pair
                 int32_t vj, vk; // Values of the operands
-                uint8_t qj, qk; // Rob entry of the operands
-                uint8_t qr;     // Rob entry of the destination
+                tag_t qj, qk;   // Tag of the operands
+                tag_t qr;       // Tag of the destination: ROB entry or physical register
+                tag_t rob;      // Rob entry of the instruction
                 bool rj, rk;    // Ready flag for operands j and k
                 bool dirty;     // Dirty flag for speculative execution
                 bool busy;      // Entry is busy in the exec buf
         } *buf;
 
+        // Age matrix: age[i * buf_size + j] is set if entry j is older than entry i
+        bool *age;
+
         int *ready_list;
+        int *prio;      // Selection priority of the ready entries
         int nb_rdy;
 } exb = {0};
 
-// ------------------ BRU
-static struct {
-        int a;
-} bru;
-
+// Waveforms of the core, ids of the signals named after hw/src/core.vhd
+static CORE_LOCAL struct wave {
+        bool on;
+        int pc, inst, disp_valid, sys_stall, sys_halt;
+        int rob_full, rob_empty, exu_full, exu_empty, ldu_full, stu_full;
+        int cdbr_vq[CDB_MAX_LANES], cdbr_tq[CDB_MAX_LANES], cdbr_rq[CDB_MAX_LANES];
+        int cdbw_req, cdbw_ack;         // One bit per initiator, the units then the LSU
+        int rd_ptr, wr_ptr, rob_count;  // u_rgu.u_rob
+        int exb_busy, exb_count;        // u_exu.u_exb, a busy bit per entry up to 64
+        int *busy;                      // Per unit, ops in flight
+} wave = {0};
+
+static const char *unit_names[NB_UNIT_TYPES] = {
+        [UNIT_ALU] = "alu",
+        [UNIT_MUL] = "mul",
+        [UNIT_DIV] = "div",
+        [UNIT_AGU] = "agu",
+        [UNIT_BRU] = "bru",
+};
+
+static CORE_LOCAL enum select_policy select_policy = SELECT_OLDEST;
+static CORE_LOCAL uint32_t select_seed = 0;
 
 // ---
 // LOCAL FUNCTIONS
@@ -68,12 +198,16 @@ static struct {
 static void exb_destroy(void) {
 
         if(exb.buf) free(exb.buf);
+        if(exb.age) free(exb.age);
         if(exb.ready_list) free(exb.ready_list);
+        if(exb.prio) free(exb.prio);
 
         exb = (struct exb) {
                 .buf_size = 0,
                 .buf = NULL,
+                .age = NULL,
                 .ready_list = NULL,
+                .prio = NULL,
                 .buf_cnt = 0,
                 .nb_rdy = 0
         };
@@ -85,12 +219,14 @@ static int exb_create(int size) {
         exb = (struct exb) {
                 .buf_size = size,
                 .buf = malloc(sizeof(*exb.buf) * size),
+                .age = calloc(size * size, sizeof(*exb.age)),
                 .ready_list = malloc(sizeof(*exb.ready_list) * size),
+                .prio = malloc(sizeof(*exb.prio) * size),
                 .buf_cnt = 0,
                 .nb_rdy = 0
         };
 
-        if(!exb.buf || !exb.ready_list)
+        if(!exb.buf || !exb.age || !exb.ready_list || !exb.prio)
                 goto CLEANUP;
 
         // Reset ROB
@@ -107,36 +243,66 @@ CLEANUP:
 
 // EXU
 static void exu_destroy(void) {
-        if(exu.units) free(exu.units);
-        if(exu.ready_list) free(exu.ready_list);
-        if(exu.done_list) free(exu.done_list);
+        if(exu.units) {
+                for(int i = 0; i < exu.nb_units; i++)
+                        if(exu.units[i].ops) free(exu.units[i].ops);
+                free(exu.units);
+        }
 
-        exu = (struct exu) {
-                .nb_units = 0,
-                .nb_rdy = 0,
-                .nb_done = 0,
-                .units = NULL,
-                .ready_list = NULL,
-                .done_list = NULL,
-        };
+        for(int t = 0; t < NB_UNIT_TYPES; t++)
+                if(exu.pool[t].ready_list) free(exu.pool[t].ready_list);
+
+        exu = (struct exu) {0};
 }
 
 
-static int exu_create(int nb_units) {
+static int exu_create(const struct unit_pool_param *pool) {
+        int nb_units = 0;
+
+        for(int t = 0; t < NB_UNIT_TYPES; t++) {
+                if(pool[t].count < 1 || pool[t].latency < 1 || pool[t].interval < 1)
+                        return -1;
+                nb_units += pool[t].count;
+        }
+
         exu = (struct exu) {
                 .nb_units = nb_units,
-                .nb_rdy = 0,
-                .nb_done = 0,
-                .units = malloc(sizeof(*exu.units) * nb_units),
-                .ready_list = malloc(sizeof(*exu.ready_list) * nb_units),
-                .done_list = malloc(sizeof(*exu.done_list) * nb_units),
+                .units = calloc(nb_units, sizeof(*exu.units)),
         };
 
-        if(!exu.units || !exu.ready_list || !exu.done_list)
+        if(!exu.units)
                 goto CLEANUP;
 
-        for(int i = 0; i < exu.nb_units; i++)
-                exu.units[i].busy = 0;
+        int u = 0;
+        for(int t = 0; t < NB_UNIT_TYPES; t++) {
+                exu.pool[t] = (struct exu_pool) {
+                        .first = u,
+                        .count = pool[t].count,
+                        .latency = pool[t].latency,
+                        .interval = pool[t].interval,
+                        .ready_list = malloc(sizeof(*exu.pool[t].ready_list) * pool[t].count),
+                        .nb_rdy = 0,
+                };
+
+                if(!exu.pool[t].ready_list)
+                        goto CLEANUP;
+
+                // A pipelined unit holds as many ops as it has stages
+                int depth = (pool[t].latency + pool[t].interval - 1) / pool[t].interval;
+
+                for(int i = 0; i < pool[t].count; i++, u++) {
+                        exu.units[u] = (struct exu_data) {
+                                .type = t,
+                                .interval_left = 0,
+                                .depth = depth,
+                                .nb_ops = 0,
+                                .ops = malloc(sizeof(*exu.units[u].ops) * depth),
+                        };
+
+                        if(!exu.units[u].ops)
+                                goto CLEANUP;
+                }
+        }
 
         return 0;
 
@@ -148,26 +314,31 @@ CLEANUP:
 
 // CDB
 static void cdb_destroy(void) {
-        if(cdb.lane)
-                free(cdb.lane);
+        if(cdb.lane) free(cdb.lane);
+        if(cdb.hold) free(cdb.hold);
+        if(cdb.req) free(cdb.req);
 
-        cdb = (struct cdb) {
-                .nb_lanes = 0,
-                .lane = NULL,
-                .nb_active_lanes = 0,
-        };
+        cdb = (struct cdb) {0};
 }
 
 
-static int cdb_create(int nb_lanes) {
+// One request per unit and per load buffer entry at most
+static int cdb_create(int nb_lanes, enum cdb_policy policy, bool lookahead, int nb_units, int lb_size) {
 
         cdb = (struct cdb) {
                 .nb_lanes = nb_lanes,
-                .lane = malloc(sizeof(*cdb.lane) * nb_lanes),
+                .lane = calloc(nb_lanes, sizeof(*cdb.lane)),
                 .nb_active_lanes = 0,
+                .policy = policy,
+                .lookahead = lookahead,
+                .nb_init = nb_units + 1,
+                .token = nb_units,
+                .hold = calloc(nb_units + 1, sizeof(*cdb.hold)),
+                .nb_req = 0,
+                .req = malloc(sizeof(*cdb.req) * (nb_units + lb_size)),
         };
 
-        if(!cdb.lane)
+        if(!cdb.lane || !cdb.hold || !cdb.req)
                 goto CLEANUP;
 
         return 0;
@@ -178,94 +349,776 @@ CLEANUP:
 }
 
 
+// WAVEFORMS
+static void wave_destroy(void) {
+        vcd_destroy();
+
+        if (wave.busy)
+                free(wave.busy);
+
+        wave = (struct wave) {0};
+}
+
+
+// The units and the CDB are created, the widths follow their sizes
+static int wave_create(const struct engine_parameters *param) {
+        char fn[FILENAME_MAX], name[32], sfx[8] = "";
+        int retval, ptr = clog2(param->rob_size) ? clog2(param->rob_size) : 1;
+
+        // Every core of a cluster has its own file
+        if (param->nb_cores > 1)
+                snprintf(fn, sizeof(fn), "%s.%d", param->vcd, param->core);
+        else
+                snprintf(fn, sizeof(fn), "%s", param->vcd);
+
+        if ((retval = vcd_create(fn, param->vcd_first, param->vcd_last)))
+                return retval;
+
+        wave = (struct wave) {
+                .on = true,
+                .busy = malloc(sizeof(*wave.busy) * exu.nb_units),
+        };
+
+        if (!wave.busy)
+                goto CLEANUP;
+
+        wave.pc = vcd_signal(NULL, "pc", 32);
+        wave.inst = vcd_signal(NULL, "inst", 32);
+        wave.disp_valid = vcd_signal(NULL, "disp_valid", 1);
+        wave.rob_full = vcd_signal(NULL, "rob_full", 1);
+        wave.rob_empty = vcd_signal(NULL, "rob_empty", 1);
+        wave.exu_full = vcd_signal(NULL, "exu_full", 1);
+        wave.exu_empty = vcd_signal(NULL, "exu_empty", 1);
+        wave.ldu_full = vcd_signal(NULL, "ldu_full", 1);
+        wave.stu_full = vcd_signal(NULL, "stu_full", 1);
+
+        // The RTL has a single lane, the others are suffixed by their index
+        for (int i = 0; i < cdb.nb_lanes; i++) {
+                if (i)
+                        snprintf(sfx, sizeof(sfx), "_%d", i);
+
+                snprintf(name, sizeof(name), "cdbr_vq%s", sfx);
+                wave.cdbr_vq[i] = vcd_signal(NULL, name, 32);
+                snprintf(name, sizeof(name), "cdbr_tq%s", sfx);
+                wave.cdbr_tq[i] = vcd_signal(NULL, name, TAG_BITS);
+                snprintf(name, sizeof(name), "cdbr_rq%s", sfx);
+                wave.cdbr_rq[i] = vcd_signal(NULL, name, 1);
+        }
+
+        // Bit vectors hold up to 64 entries, the first ones
+        wave.cdbw_req = vcd_signal(NULL, "cdbw_req", cdb.nb_init < 64 ? cdb.nb_init : 64);
+        wave.cdbw_ack = vcd_signal(NULL, "cdbw_ack", cdb.nb_init < 64 ? cdb.nb_init : 64);
+        wave.sys_stall = vcd_signal(NULL, "sys_stall", 1);
+        wave.sys_halt = vcd_signal(NULL, "sys_halt", 1);
+
+        wave.rd_ptr = vcd_signal("u_rgu.u_rob", "rd_ptr", ptr);
+        wave.wr_ptr = vcd_signal("u_rgu.u_rob", "wr_ptr", ptr);
+        wave.rob_count = vcd_signal("u_rgu.u_rob", "count", clog2(param->rob_size + 1));
+
+        // Units numbered within their pool: alu0, alu1, mul0...
+        for (int u = 0, k = 0; u < exu.nb_units; u++) {
+                k = u && exu.units[u].type == exu.units[u - 1].type ? k + 1 : 0;
+                snprintf(name, sizeof(name), "%s%d_busy", unit_names[exu.units[u].type], k);
+                wave.busy[u] = vcd_signal("u_exu", name, 1);
+        }
+
+        wave.exb_busy = vcd_signal("u_exu.u_exb", "busy", exb.buf_size < 64 ? exb.buf_size : 64);
+        wave.exb_count = vcd_signal("u_exu.u_exb", "count", clog2(exb.buf_size + 1));
+
+        // Once a declaration failed every later one does
+        if (wave.exb_count < 0)
+                goto CLEANUP;
+
+        return 0;
+
+CLEANUP:
+        wave_destroy();
+        return ENOMEM;
+}
+
+
+// The state of the core at the end of the cycle
+static void wave_sample(int slots) {
+        uint64_t req = 0, ack = 0, busy = 0;
+        int rd_ptr, wr_ptr;
+
+        vcd_set(wave.pc, PC);
+        vcd_set(wave.inst, instruction);
+        vcd_set(wave.disp_valid, slots > 0);
+        vcd_set(wave.rob_full, rob_full());
+        vcd_set(wave.rob_empty, rob_empty());
+        vcd_set(wave.exu_full, exb.buf_cnt == exb.buf_size);
+        vcd_set(wave.exu_empty, exb.buf_cnt == 0);
+        vcd_set(wave.ldu_full, lsu_full_load());
+        vcd_set(wave.stu_full, lsu_full_store());
+
+        for (int i = 0; i < cdb.nb_lanes; i++) {
+                vcd_set(wave.cdbr_vq[i], (uint32_t)cdb.lane[i].result);
+                vcd_set(wave.cdbr_tq[i], cdb.lane[i].qr);
+                vcd_set(wave.cdbr_rq[i], cdb.lane[i].valid);
+        }
+
+        // The requests are sorted by the arbiter, the first ones got a lane
+        for (int i = 0; i < cdb.nb_req; i++) {
+                if (cdb.req[i].init >= 64)
+                        continue;
+
+                req |= (uint64_t)1 << cdb.req[i].init;
+                if (i < cdb.nb_active_lanes)
+                        ack |= (uint64_t)1 << cdb.req[i].init;
+        }
+        vcd_set(wave.cdbw_req, req);
+        vcd_set(wave.cdbw_ack, ack);
+
+        vcd_set(wave.sys_stall, !halt && !slots);
+        vcd_set(wave.sys_halt, halt);
+
+        rob_ptr(&rd_ptr, &wr_ptr);
+        vcd_set(wave.rd_ptr, rd_ptr);
+        vcd_set(wave.wr_ptr, wr_ptr);
+        vcd_set(wave.rob_count, recovery.rob_size - rob_free());
+
+        for (int u = 0; u < exu.nb_units; u++)
+                vcd_set(wave.busy[u], exu.units[u].nb_ops > 0);
+
+        for (int i = 0; i < exb.buf_size && i < 64; i++)
+                if (exb.buf[i].busy)
+                        busy |= (uint64_t)1 << i;
+        vcd_set(wave.exb_busy, busy);
+        vcd_set(wave.exb_count, exb.buf_cnt);
+
+        vcd_tick(stats.cycles);
+}
+
+
+// CHECKPOINTS
+static int ckpt_find(tag_t rob_addr) {
+        for (int i = 0; i < recovery.nb_ckpt; i++)
+                if (recovery.ckpt[i].busy && recovery.ckpt[i].rob == rob_addr)
+                        return i;
+
+        return -1;
+}
+
+
+// Snapshots the rename state after a branch, returns -1 if every
+// checkpoint is in use
+static int ckpt_take(tag_t rob_addr) {
+        for (int i = 0; i < recovery.nb_ckpt; i++) {
+                if (!recovery.ckpt[i].busy) {
+                        if (rename_mode == RENAME_PRF)
+                                prf_checkpoint(i);
+                        else
+                                reg_checkpoint(i);
+
+                        recovery.ckpt[i] = (struct checkpoint) {
+                                .rob = rob_addr,
+                                .busy = true,
+                        };
+                        return i;
+                }
+        }
+
+        return -1;
+}
+
+
+// Branch resolved, its checkpoint is not needed anymore
+static void ckpt_release(tag_t rob_addr) {
+        int i = ckpt_find(rob_addr);
+
+        if (i >= 0)
+                recovery.ckpt[i].busy = false;
+}
+
+
 // EXECUTION
+// If operand is in registers go fetch it,
+// else the value might be on the CDB or in the ROB,
+//      if it is not available then it must be waited for
+// Returns true if the value of the operand is available
+static bool read_operand(uint8_t addr, tag_t *q, int32_t *v) {
+
+        if (rename_mode == RENAME_PRF) {
+                if (prf_read(addr, q, v)) {
+                        stats.reads_reg++;
+                        return true;
+                }
+        } else {
+                if (!reg_read_src(addr, q)) {
+                        reg_read_data(addr, v);
+                        stats.reads_reg++;
+                        return true;
+                }
+        }
+
+        for(int i = 0; i < cdb.nb_lanes; i++) {
+                if(cdb.lane[i].valid && cdb.lane[i].qr == *q) {
+                        *v = cdb.lane[i].result;
+                        stats.reads_cdb++;
+                        return true;
+                }
+        }
+
+        if(rename_mode == RENAME_ROB && rob_read(*q, v)) {
+                stats.reads_rob++;
+                return true;
+        }
+
+        // could not find operand, therefore need to wait
+        return false;
+}
+
+
+// Scoreboard mask of the registers read by an instruction
+static uint64_t src_mask(const struct inst_field *i) {
+        switch (i->opcode) {
+                case OP_OP:
+                case OP_BRANCH:
+                case OP_STORE:
+                case OP_AMO:
+                        return reg_bit(i->rs1) | reg_bit(i->rs2);
+                case OP_IMM:
+                case OP_LOAD:
+                case OP_JALR:
+                        return reg_bit(i->rs1);
+                default:
+                        return 0;
+        }
+}
+
+
+// Renames the destination of an instruction, the tag is either the ROB
+// entry or the physical register allocated to it
+static tag_t rename_dest(uint8_t rd, tag_t rob_addr) {
+        tag_t qr, prev;
+
+        if (rename_mode == RENAME_PRF) {
+                prf_rename(rd, &qr, &prev);
+                rob_rename(rob_addr, qr, prev);
+                return qr;
+        }
+
+        // Previous source is kept to walk back the rename, an entry
+        // pointing to itself means the register was not renamed
+        if (!reg_read_src(rd, &prev))
+                prev = rob_addr;
+        rob_rename(rob_addr, rob_addr, prev);
+
+        reg_write_src(rd, rob_addr);
+
+        return rob_addr;
+}
+
+
+// Cycles are charged to the addresses inside the regions of interest
+static bool profiling(void) {
+        return profile && (roi.mode == ROI_OFF || roi.inside);
+}
+
+
+// REGION OF INTEREST
+_Static_assert(sizeof(struct engine_stats) % sizeof(uint64_t) == 0, "engine_stats only holds uint64_t counters");
+
+// d += a - b, counter by counter
+static void stats_add(struct engine_stats *d, const struct engine_stats *a, const struct engine_stats *b) {
+        uint64_t *pd = (uint64_t *)d;
+        const uint64_t *pa = (const uint64_t *)a;
+        const uint64_t *pb = (const uint64_t *)b;
+
+        for (size_t i = 0; i < sizeof(*d) / sizeof(uint64_t); i++)
+                pd[i] += pa[i] - pb[i];
+}
+
+
+// Statistics of the whole program
+static void raw_stats(struct engine_stats *s) {
+        struct lsu_stats ls;
+
+        *s = stats;
+
+        lsu_get_stats(&ls);
+        s->loads_speculated = ls.speculated;
+        s->loads_waited = ls.waits;
+        s->wcb_stores = ls.wcb_stores;
+        s->wcb_coalesced = ls.wcb_coalesced;
+        s->wcb_drained = ls.wcb_drained;
+        s->wcb_drain_stalls = ls.wcb_drain_stalls;
+        s->wcb_forwards = ls.wcb_forwards;
+        s->atomics = ls.atomics;
+        s->atomic_cycles = ls.atomic_cycles;
+        s->sc_failures = ls.sc_failures;
+
+        cache_get_stats(&s->l1d);
+
+        // Until a mispredict squashes it, the halt ends the program
+        s->slots_empty[SLOT_FRONTEND] += topdown.halted;
+
+        // The thread is done with the file once it has pushed its last record
+        struct trace_file *t = func.out ? func.out : func.in;
+        if (t && atomic_load_explicit(&func.done, memory_order_acquire)) {
+                s->trace_records = t->records;
+                s->trace_bytes = t->bytes;
+        }
+}
+
+
+// Statistics of the regions left so far and of the current one
+static void roi_stats(struct engine_stats *s) {
+        struct engine_stats raw;
+
+        raw_stats(&raw);
+        if (roi.mode == ROI_OFF) {
+                *s = raw;
+                return;
+        }
+
+        *s = roi.total;
+        if (roi.inside)
+                stats_add(s, &raw, &roi.start);
+
+        // Not counted by region
+        s->storage_bits = raw.storage_bits;
+        s->trace_records = raw.trace_records;
+        s->trace_bytes = raw.trace_bytes;
+        s->roi_regions = raw.roi_regions;
+        s->roi_dumps = raw.roi_dumps;
+        s->fast_forwarded = raw.fast_forwarded;
+}
+
+
+static bool roi_marker(uint32_t inst) {
+        return inst == ROI_BEGIN || inst == ROI_END || inst == ROI_DUMP || inst == ROI_RESET;
+}
+
+
+static void roi_mark(uint32_t marker) {
+        struct engine_stats raw, *d;
+
+        raw_stats(&raw);
+
+        switch (marker) {
+                case ROI_BEGIN:
+                        if (roi.inside)
+                                break;
+                        roi.start = raw;
+                        roi.inside = true;
+                        stats.roi_regions++;
+                        if (critical)
+                                crit_start(stats.cycles);
+                        break;
+                case ROI_END:
+                        if (!roi.inside)
+                                break;
+                        stats_add(&roi.total, &raw, &roi.start);
+                        roi.inside = false;
+                        if (critical)
+                                crit_stop();
+                        break;
+                case ROI_DUMP:
+                        if (!(d = realloc(roi.dumps, (roi.nb_dumps + 1) * sizeof(*d))))
+                                break;
+                        roi.dumps = d;
+                        stats.roi_dumps++;
+                        roi_stats(&roi.dumps[roi.nb_dumps++]);
+                        break;
+                case ROI_RESET:
+                        roi.total = (struct engine_stats) {0};
+                        roi.start = raw;
+                        break;
+        }
+}
+
+
+// Architectural registers, once the backend is empty every register holds
+// its committed value
+static int32_t arch_read(uint8_t addr) {
+        int32_t v;
+        tag_t q;
+
+        if (rename_mode == RENAME_PRF)
+                prf_read(addr, &q, &v);
+        else
+                reg_read_data(addr, &v);
+
+        return v;
+}
+
+
+static void arch_write(uint8_t addr, int32_t v) {
+        int32_t old;
+        tag_t q;
+
+        if (rename_mode == RENAME_PRF) {
+                prf_read(addr, &q, &old);
+                prf_write(q, v);
+        } else {
+                reg_write_data(addr, v);
+        }
+}
+
+
+// Hands the program over to the functional model after ROI_END, a replayed
+// trace has no values and only moves on the records
+static void fast_enter(void) {
+        roi.fast = true;
+
+        if (frontend != FRONTEND_INTEGRATED)
+                ring_pop(&ring, 1);
+        if (frontend == FRONTEND_REPLAY)
+                return;
+
+        for (int i = 1; i < 32; i++)
+                roi.ff.x[i] = arch_read(i);
+        roi.ff.pc = PC + 4;
+}
+
+
+// Takes the program back on ROI_BEGIN or once it has ended
+static void fast_leave(void) {
+        roi.fast = false;
+
+        if (frontend == FRONTEND_REPLAY)
+                return;
+
+        for (int i = 1; i < 32; i++)
+                arch_write(i, roi.ff.x[i]);
+        PC = roi.ff.pc;
+}
+
+
+// Runs one instruction without the timing model, the memory accesses keep
+// the L1D warm. A decoupled frontend drops the record of the instruction
+static void fast_forward(void) {
+        struct trace_inst t;
+        uint32_t inst;
+        int r = 1;
+
+        // Waits for the record of the thread
+        if (frontend != FRONTEND_INTEGRATED)
+                t = *ring_peek(&ring, 0);
+
+        if (frontend == FRONTEND_REPLAY)
+                inst = t.inst;
+        else
+                mem_read(roi.ff.pc, &inst, sizeof(inst));
+
+        if (roi_marker(inst)) {
+                if (inst == ROI_BEGIN) {
+                        fast_leave();
+                        return;
+                }
+
+                roi_mark(inst);
+                if (frontend != FRONTEND_INTEGRATED)
+                        ring_pop(&ring, 1);
+                roi.ff.pc += 4;
+                return;
+        }
+
+        if (frontend == FRONTEND_REPLAY) {
+                struct inst_field i = decode(inst);
+
+                r = inst != 0 && !(i.opcode == OP_SYSTEM && i.funct3 == FUNCT3_PRIV);
+        } else if ((r = func_step(&roi.ff, &t)) < 0) {
+                return;
+        }
+
+        if (r == 0) {
+                halt = true;
+                fast_leave();
+                return;
+        }
+
+        if (frontend != FRONTEND_INTEGRATED)
+                ring_pop(&ring, 1);
+
+        stats.fast_forwarded++;
+
+        switch (decode(t.inst).opcode) {
+                case OP_LOAD:
+                        cache_load(t.addr, t.pc);
+                        break;
+                case OP_STORE:
+                        cache_store(t.addr, t.pc);
+                        break;
+                case OP_AMO:
+                        cache_atomic(t.addr);
+                        break;
+        }
+}
+
+
+// Slots lost to a full backend are charged to memory when the oldest op is
+// a load, a store or an atomic, or when only stores are left to drain
+static enum slot_class backend(void) {
+        tag_t head;
+
+        if (rob_head(&head))
+                return topdown.rob[head].mem ? SLOT_MEMORY : SLOT_CORE;
+
+        return lsu_drained() ? SLOT_CORE : SLOT_MEMORY;
+}
+
+
+// Returns -1 if the instruction could not be dispatched, 1 if it ends the
+// dispatch group because it is predicted taken, else 0
 static int dispatch() {
 
         // TODO: Make a global instruction bus
         //       Make a dispatcher that masks the instruction lanes according to the thingy
 
         // TODO: Check if instruction is valid
-        if (instruction == 0)
+        // A null instruction or an ECALL/EBREAK ends the program: stop
+        // fetching and let the backend drain
+        topdown.stall = SLOT_FRONTEND;
+        if (instruction == 0) {
+                halt = true;
                 return -1;
+        }
 
         struct inst_field inst = decode(instruction);
 
-
-        if (rob_full())
+        if (inst.opcode == OP_SYSTEM && inst.funct3 == FUNCT3_PRIV) {
+                halt = true;
                 return -1;
+        }
 
-        uint8_t qr;
-        rob_issue(inst.rd, &qr);
-
-        uint16_t f10 = 0; // Default operation is ADD
+        // Markers act once every older instruction has committed so the
+        // counters stop at an exact point of the program, never on the
+        // wrong path. They are then dispatched as nops
+        if (roi.mode != ROI_OFF && roi_marker(instruction)) {
+                if (!rob_empty() || !lsu_drained()) {
+                        topdown.stall = backend();
+                        if (critical)
+                                crit_block(CRIT_ROB);
+                        return -1;
+                }
 
-        uint8_t qj, qk;
-        int32_t vj,vk;
-        bool rj = true, rk = true;
+                roi_mark(instruction);
+                if (instruction == ROI_END && roi.mode == ROI_FAST) {
+                        fast_enter();
+                        return -1;
+                }
+        }
 
-        // If operand is in registers go fetch it,
-        // else the value might be on the CDB or in the ROB,
-        //      if it is not available then
-        if (!reg_read_src(inst.rs1, &qj)) {
-                reg_read_data(inst.rs1, &vj);
-        } else {
-                for(int i = 0; i < cdb.nb_lanes; i++) {
-                        if(cdb.lane[i].valid && cdb.lane[i].qr == qj) {
-                                vj = cdb.lane[i].result;
-                                goto OP_J_DONE;
-                        }
+        // Macro-op fusion with the next instruction, the fused op is
+        // dispatched at the address of the second instruction
+        uint32_t pc = PC;
+        struct fused_op f;
+        struct inst_field pair;
+        int fuse = -1;
+
+        if (fusion) {
+                pair = decode(next_instruction);
+                fuse = fusion_match(&inst, &pair, fusion, &f);
+
+                // A load pair needs room for both loads
+                if (fuse == FUSION_LOAD_PAIR && (rob_free() < 2 || lsu_free_load() < 2
+                        || (rename_mode == RENAME_PRF && prf_free() < 2)))
+                        fuse = -1;
+
+                if (fuse >= 0) {
+                        inst = f.inst;
+                        pc = PC + 4;
                 }
-                if(rob_read(qj, &vj))
-                        goto OP_J_DONE;
+        }
+
+        // Actual outcome of the op, a fused op ends with its second record
+        uint32_t onpc = 0, addr = 0;
+        trace_used = fuse >= 0 ? 2 : 1;
+        if (frontend != FRONTEND_INTEGRATED) {
+                onpc = trace[trace_used - 1]->npc;
+                addr = trace[0]->addr;
+        }
 
-                // could not find operand, therefore need to wait
-                rj = false;
+        if (rob_full()) {
+                stats.rob_full++;
+                topdown.stall = backend();
+                if (critical)
+                        crit_block(CRIT_ROB);
+                return -1;
         }
 
-OP_J_DONE:
+        if (exb.buf_cnt == exb.buf_size) {
+                stats.exb_full++;
+                topdown.stall = backend();
+                if (critical)
+                        crit_block(CRIT_EXB);
+                return -1;
+        }
+
+        // An atomic takes an entry in both buffers
+        if (((inst.opcode == OP_LOAD || inst.opcode == OP_AMO) && lsu_full_load())
+                || ((inst.opcode == OP_STORE || inst.opcode == OP_AMO) && lsu_full_store())) {
+                stats.lsq_full++;
+                topdown.stall = SLOT_MEMORY;
+                if (critical)
+                        crit_block(CRIT_ROB);
+                return -1;
+        }
+
+        if (rename_mode == RENAME_PRF && inst.rd != 0 && prf_full()) {
+                stats.prf_full++;
+                topdown.stall = backend();
+                if (critical)
+                        crit_block(CRIT_ROB);
+                return -1;
+        }
+
+        // Sources produced by an older instruction of the same group must
+        // take the tag renamed in this cycle instead of the register map
+        uint64_t writes = reg_bit(inst.rd) | (fuse == FUSION_LOAD_PAIR ? reg_bit(pair.rd) : 0);
+        stats.group_deps += __builtin_popcountll(src_mask(&inst) & group_writes & ~reg_bit(0));
+        group_writes |= writes;
+        stats.dispatched++;
+
+        tag_t rob_addr;
+        rob_issue(inst.rd, &rob_addr);
+        topdown.rob[rob_addr] = (struct topdown_rob) {.slot = true,
+                .mem = inst.opcode == OP_LOAD || inst.opcode == OP_STORE || inst.opcode == OP_AMO};
+        if (critical)
+                crit_dispatch(rob_addr, stats.cycles);
+
+        // A fused op is charged to its second instruction, the first load
+        // of a pair keeps its own address
+        if (profile)
+                prof_dispatch(rob_addr, fuse == FUSION_LOAD_PAIR ? PC : pc,
+                        fuse >= 0 && fuse != FUSION_LOAD_PAIR ? next_instruction : instruction, stats.cycles);
+
+        // Both instructions of a fused op retire with its entry
+        if (fuse >= 0 && fuse != FUSION_LOAD_PAIR)
+                rob_set_fused(rob_addr);
+
+        // Static prediction: jumps and backward branches are taken, the
+        // target of a JALR is unknown so it falls through
+        next_pc = pc + 4;
+        if (inst.opcode == OP_JAL || (inst.opcode == OP_BRANCH && inst.immediate < 0))
+                next_pc = pc + inst.immediate;
+
+        uint16_t f10 = 0; // Default operation is ADD
+
+        tag_t qj, qk, qr;
+        int32_t vj,vk;
+        bool rj, rk = true;
+        struct lsu_buf amo_data;
+
+        rj = read_operand(inst.rs1, &qj, &vj);
 
         switch(inst.opcode) {
                 case OP_IMM:
                         f10 = inst.funct3;
+
+                        // Shift amount is encoded in the immediate
+                        if (f10 == FUNCT3_SL || f10 == FUNCT3_SR) {
+                                if (inst.immediate & 0x400)
+                                        f10 = F10_SRA;
+                                inst.immediate &= 0x1F;
+                        }
+                        // fall through
                 case OP_LOAD:
                 case OP_STORE:
-                case OP_AUIPC:
+                case OP_LUI:
                         qk = 0;
                         vk = inst.immediate;
                         break;
+                // The address is rs1, rs2 goes to the LSU and must be read
+                // before rd is renamed
+                case OP_AMO:
+                        amo_data.r = read_operand(inst.rs2, &amo_data.q, (int32_t *)&amo_data.value);
+                        qk = 0;
+                        vk = 0;
+                        break;
+                // CSR access, the immediate forms take zimm in the rs1 field.
+                // CSRRS/CSRRC with x0 or a zero zimm only read, CSR_WRITE is
+                // set for the others
+                case OP_SYSTEM:
+                        f10 = inst.funct3;
+                        if ((inst.funct3 & 0x3) == 1 || inst.rs1)
+                                f10 |= CSR_WRITE;
+                        qk = 0;
+                        vk = inst.immediate & 0xFFF;
+                        if (inst.funct3 & 0x4) {
+                                qj = 0;
+                                vj = inst.rs1;
+                                rj = true;
+                        }
+                        break;
+                case OP_AUIPC:
+                        qj = qk = 0;
+                        vj = pc;
+                        vk = inst.immediate;
+                        rj = true;
+                        break;
+                case OP_BRANCH:
+                        // Compare & branch fused with a slti/sltiu
+                        if (fuse == FUSION_CMP_BRANCH && f.imm) {
+                                f10 = inst.funct3;
+                                qk = 0;
+                                vk = f.operand;
+                                break;
+                        }
+                        // fall through
                 default:
                         f10 = (inst.funct7 << 3) | inst.funct3;
-
-                        if (!reg_read_src(inst.rs2, &qk)) {
-                                reg_read_data(inst.rs2, &vk);
-                        } else {
-                                for(int i = 0; i < cdb.nb_lanes; i++) {
-                                        if(cdb.lane[i].valid && cdb.lane[i].qr == qk) {
-                                                vk = cdb.lane[i].result;
-                                                goto OP_K_DONE;
-                                        }
-                                }
-
-                                if(rob_read(qk, &vj)) {
-                                        goto OP_K_DONE;
-                                }
-                                rk = false;
-                        }
-
+                        rk = read_operand(inst.rs2, &qk, &vk);
                         break;
         }
 
-OP_K_DONE:
+        qr = rename_dest(inst.rd, rob_addr);
 
-        reg_write_src(inst.rd, qr);
+        // Branches that can mispredict get a checkpoint of the rename state
+        // including their own destination
+        if (inst.opcode == OP_BRANCH || inst.opcode == OP_JALR) {
+                stats.branches++;
+                if (ckpt_take(rob_addr) < 0)
+                        stats.ckpt_misses++;
+        }
+
+        // LSU: Create entry for instruction, the AGU computes the address
+        int lsq = -1, lsq2 = -1;
+        if (inst.opcode == OP_LOAD) {
+                // The second load of a pair writes another register, it
+                // keeps its own ROB entry but shares the address computation
+                if (fuse == FUSION_LOAD_PAIR) {
+                        tag_t rob2;
+                        lsq = lsu_sched_load(inst.funct3, qr, rob_addr, pc - 4);
+                        rob_issue(pair.rd, &rob2);
+                        topdown.rob[rob2] = (struct topdown_rob) {.mem = true};
+                        if (critical)
+                                crit_dispatch(rob2, stats.cycles);
+                        if (profile)
+                                prof_dispatch(rob2, pc, next_instruction, stats.cycles);
+                        lsq2 = lsu_sched_load(pair.funct3, rename_dest(pair.rd, rob2), rob2, pc);
+                } else {
+                        lsq = lsu_sched_load(inst.funct3, qr, rob_addr, pc);
+                }
+        } else if (inst.opcode == OP_STORE) {
+                struct lsu_buf data;
+                data.r = read_operand(inst.rs2, &data.q, (int32_t *)&data.value);
+                lsq = lsu_sched_store(data, inst.funct3, rob_addr, pc);
+        } else if (inst.opcode == OP_AMO) {
+                lsq = lsu_sched_amo(amo_data, inst.funct7, qr, rob_addr, pc);
+        }
 
         for (int i = 0; i < exb.buf_size; i++) {
                 if (!exb.buf[i].busy) {
                         exb.buf[i] = (struct exb_data) {
                                 .f10    = f10,
+                                .op     = inst.opcode,
+                                .type   = unit_get_type(inst.opcode, f10),
+                                .pc     = pc,
+                                .npc    = next_pc,
+                                .onpc   = onpc,
+                                .addr   = addr,
+                                .imm    = inst.immediate,
+                                .fuse   = fuse,
+                                .lsq    = lsq,
+                                .lsq2   = lsq2,
                                 .qj     = qj,
                                 .qk     = qk,
                                 .qr     = qr,
+                                .rob    = rob_addr,
                                 .vj     = vj,
                                 .vk     = vk,
                                 .rj     = rj,
@@ -273,14 +1126,131 @@ OP_K_DONE:
                                 .dirty  = false,
                                 .busy  = true,
                         };
+                        exb.buf_cnt++;
+
+                        // New entry is younger than every busy entry
+                        for (int j = 0; j < exb.buf_size; j++) {
+                                exb.age[i * exb.buf_size + j] = exb.buf[j].busy && j != i;
+                                exb.age[j * exb.buf_size + i] = false;
+                        }
                         break;
                 }
         }
 
-        // LSU: Create entry for instruction
-        // BRU: Create entry for instruction
+        if (fuse >= 0)
+                stats.fusion_hits[fuse]++;
 
-        return 0;
+        return next_pc != pc + 4;
+}
+
+
+// Number of busy entries older than entry i, 0 is the oldest
+static int exb_age(int i) {
+        int n = 0;
+
+        for (int j = 0; j < exb.buf_size; j++)
+                if (exb.buf[j].busy && exb.age[i * exb.buf_size + j])
+                        n++;
+
+        return n;
+}
+
+
+// Number of entries waiting on the result of entry i
+static int exb_dependents(int i) {
+        int n = 0;
+        tag_t qr = exb.buf[i].qr;
+
+        for (int j = 0; j < exb.buf_size; j++) {
+                if (!exb.buf[j].busy)
+                        continue;
+
+                if ((!exb.buf[j].rj && exb.buf[j].qj == qr) || (!exb.buf[j].rk && exb.buf[j].qk == qr))
+                        n++;
+        }
+
+        return n;
+}
+
+
+// Orders the ready list by priority according to the selection policy, the
+// first entries of the list are issued first
+static void exb_select(void) {
+
+        if (select_policy == SELECT_POSITION)
+                return;
+
+        for (int i = 0; i < exb.nb_rdy; i++) {
+                int e = exb.ready_list[i];
+
+                switch (select_policy) {
+                        case SELECT_OLDEST:
+                                exb.prio[i] = -exb_age(e);
+                                break;
+                        case SELECT_RANDOM:
+                                // xorshift32
+                                select_seed ^= select_seed << 13;
+                                select_seed ^= select_seed >> 17;
+                                select_seed ^= select_seed << 5;
+                                exb.prio[i] = select_seed & 0xFFFF;
+                                break;
+                        case SELECT_CRITICAL:
+                                // Most dependents first, then oldest
+                                exb.prio[i] = exb_dependents(e) * exb.buf_size * 2 - exb_age(e);
+                                break;
+                        default:
+                                exb.prio[i] = 0;
+                                break;
+                }
+        }
+
+        // Insertion sort, highest priority first
+        for (int i = 1; i < exb.nb_rdy; i++) {
+                int e = exb.ready_list[i];
+                int p = exb.prio[i];
+                int j = i - 1;
+
+                while (j >= 0 && exb.prio[j] < p) {
+                        exb.ready_list[j + 1] = exb.ready_list[j];
+                        exb.prio[j + 1] = exb.prio[j];
+                        j--;
+                }
+
+                exb.ready_list[j + 1] = e;
+                exb.prio[j + 1] = p;
+        }
+}
+
+
+// Totals of the events the CSR counters count, as of this cycle
+static void csr_events(uint64_t *ev) {
+        struct cache_stats cs;
+        struct lsu_stats ls;
+
+        cache_get_stats(&cs);
+        lsu_get_stats(&ls);
+
+        ev[EVENT_NONE] = 0;
+        ev[EVENT_CYCLES] = stats.cycles;
+        ev[EVENT_INSTRET] = stats.instret;
+        ev[EVENT_BRANCHES] = stats.branches;
+        ev[EVENT_MISPREDICTS] = stats.mispredicts;
+        ev[EVENT_SQUASHED] = stats.squashed;
+        ev[EVENT_RECOVERY] = stats.recovery_cycles;
+        ev[EVENT_ROB_FULL] = stats.rob_full;
+        ev[EVENT_EXB_FULL] = stats.exb_full;
+        ev[EVENT_LSQ_FULL] = stats.lsq_full;
+        ev[EVENT_PRF_FULL] = stats.prf_full;
+        ev[EVENT_CDB_STALLS] = 0;
+        for (int t = 0; t <= NB_UNIT_TYPES; t++)
+                ev[EVENT_CDB_STALLS] += stats.cdb_stalls[t];
+        ev[EVENT_L1D_LOADS] = cs.loads;
+        ev[EVENT_L1D_STORES] = cs.stores;
+        ev[EVENT_L1D_MISSES] = cs.misses;
+        ev[EVENT_STORE_STALLS] = stats.store_stalls;
+        ev[EVENT_VIOLATIONS] = ls.violations;
+        ev[EVENT_ATOMICS] = ls.atomics;
+        ev[EVENT_SC_FAILURES] = ls.sc_failures;
 }
 
 
@@ -290,7 +1260,7 @@ OP_K_DONE:
 // 3. Dispatch to execution units
 static int issue(void) {
 
-        int nb_issue;
+        int nb_issue = 0;
 
         // Detect which exb is ready
         exb.nb_rdy = 0;
@@ -299,59 +1269,282 @@ static int issue(void) {
                         exb.ready_list[exb.nb_rdy++] = i;
         }
 
-        // Detect which exu are ready
-        exu.nb_rdy = 0;
-        for (int i = 0; i < exu.nb_units; i++) {
-                if (!exu.units[i].busy)
-                        exu.ready_list[exu.nb_rdy++] = i;
+        // Detect which units of every pool can accept an op
+        for (int t = 0; t < NB_UNIT_TYPES; t++) {
+                struct exu_pool *p = &exu.pool[t];
+
+                p->nb_rdy = 0;
+                for (int i = p->first; i < p->first + p->count; i++) {
+                        if (exu.units[i].interval_left == 0 && exu.units[i].nb_ops < exu.units[i].depth)
+                                p->ready_list[p->nb_rdy++] = i;
+                }
         }
 
         // Selection algorithm
-        // FIXME: add capabilities detection algorithm to select right instructions/stuff
         // TODO: Round robbin units ?
-        if(exb.nb_rdy > exu.nb_rdy)
-                nb_issue = exu.nb_rdy;
-        else
-                nb_issue = exb.nb_rdy;
+        exb_select();
+
+        int taken[NB_UNIT_TYPES] = {0};
+        tag_t head;
+
+        for (int i = 0; i < exb.nb_rdy; i++) {
+                int exb_index = exb.ready_list[i];
+                struct exb_data *e = &exb.buf[exb_index];
+                struct exu_pool *p = &exu.pool[e->type];
+
+                // A CSR access waits to be the oldest op, every older one
+                // has retired and the counters it reads are exact
+                if (e->op == OP_SYSTEM && (!rob_head(&head) || head != e->rob))
+                        continue;
+
+                // Only a unit of the right pool can execute the op
+                if (taken[e->type] == p->nb_rdy) {
+                        stats.pool_stalls[e->type]++;
+                        continue;
+                }
 
-        int unit_index;
-        int exb_index;
-        for(int i = 0; i < nb_issue; i++) {
-                //TODO: Select which to use, for now only the first ones
-                unit_index = exu.ready_list[i];
-                exb_index = exb.ready_list[i];
+                struct exu_data *u = &exu.units[p->ready_list[taken[e->type]++]];
+                struct exu_op *o = &u->ops[u->nb_ops++];
+
+                switch (e->type) {
+                        case UNIT_AGU:
+                                o->result = frontend != FRONTEND_INTEGRATED ? e->addr : e->vj + e->vk;
+                                break;
+                        case UNIT_BRU:
+                                o->result = bru_exec(e->f10, e->op, e->pc, e->vj, e->vk);
+
+                                // The slt result of a fused compare & branch is
+                                // the condition of the blt, inverted for a bge
+                                if (e->fuse == FUSION_CMP_BRANCH)
+                                        o->result ^= e->f10 & 1;
+                                break;
+                        default:
+                                if (e->op == OP_SYSTEM) {
+                                        uint64_t ev[NB_EVENTS];
+                                        uint32_t old;
+
+                                        csr_events(ev);
+                                        csr_access(e->vk, e->f10 & 0x7, e->vj, e->f10 & CSR_WRITE, ev, &old);
+                                        o->result = old;
+                                } else {
+                                        o->result = alu_exec(e->f10, e->vj, e->vk);
+                                }
+                                break;
+                }
+
+                o->branch = e->type == UNIT_BRU;
+                if (o->branch) {
+                        if (frontend != FRONTEND_INTEGRATED)
+                                o->npc = e->onpc;
+                        else
+                                o->npc = bru_next_pc(e->f10, e->op, e->pc, e->vj, e->vk, e->imm);
+                        o->mispredict = o->npc != e->npc;
+                }
 
-                // Load in unit
-                exu.units[unit_index].result = alu_exec(exb.buf[exb_index].f10, exb.buf[exb_index].vj, exb.buf[exb_index].vk);
-                exu.units[unit_index].cycle_left = alu_get_cycle(exb.buf[exb_index].f10);
-                exu.units[unit_index].busy = true;
-                exu.units[unit_index].qr = exb.buf[exb_index].qr;
+                o->qr = e->qr;
+                o->rob = e->rob;
+                o->lsq = e->lsq;
+                o->lsq2 = e->lsq2;
+                o->store = e->op == OP_STORE || e->op == OP_AMO;
+                o->wb = e->type != UNIT_AGU && (e->op != OP_BRANCH || e->fuse == FUSION_CMP_BRANCH);
+                o->cycle_left = p->latency;
+
+                u->interval_left = p->interval;
+                if (critical)
+                        crit_issue(e->rob, stats.cycles, p->latency, e->type == UNIT_AGU);
+
+                stats.pool_issued[e->type]++;
+                nb_issue++;
 
                 // Reset exb entry
-                exb.buf[exb_index].busy = false;
+                e->busy = false;
+                exb.buf_cnt--;
         }
 
         return nb_issue;
 }
 
 
+// Removes the oldest op of a unit
+static void exu_pop(struct exu_data *u) {
+        for (int j = 1; j < u->nb_ops; j++)
+                u->ops[j - 1] = u->ops[j];
+        u->nb_ops--;
+}
+
+
 static int execute(void) {
 
         //1. For all exec units
         //2. Propagate values
         for(int i=0; i < exu.nb_units; i++) {
-                if (exu.units[i].busy && exu.units[i].cycle_left != 0)
-                        exu.units[i].cycle_left -= 1;
+                struct exu_data *u = &exu.units[i];
+
+                if (u->interval_left != 0)
+                        u->interval_left -= 1;
+
+                for (int j = 0; j < u->nb_ops; j++)
+                        if (u->ops[j].cycle_left != 0)
+                                u->ops[j].cycle_left -= 1;
         }
 
         //3. Execute LSU
-
-        //4. Execute BRU
+        lsu_exec();
 
         return 0;
 }
 
 
+// Removes every instruction younger than the mispredicted branch and
+// restores the rename state, from the checkpoint of the branch if it has
+// one, else by undoing the renames of the squashed instructions one by one
+static void recover(tag_t rob_addr, uint32_t pc) {
+        int age = rob_age(rob_addr);
+
+        for (int i = 0; i < exb.buf_size; i++) {
+                if (exb.buf[i].busy && rob_age(exb.buf[i].rob) > age) {
+                        exb.buf[i].busy = false;
+                        exb.buf_cnt--;
+                }
+        }
+
+        for (int i = 0; i < exu.nb_units; i++) {
+                struct exu_data *u = &exu.units[i];
+                int n = 0;
+
+                for (int j = 0; j < u->nb_ops; j++)
+                        if (rob_age(u->ops[j].rob) <= age)
+                                u->ops[n++] = u->ops[j];
+                u->nb_ops = n;
+        }
+
+        lsu_squash(rob_addr);
+
+        // Squashed entries keep their content, they are walked from the
+        // youngest to the oldest
+        int n = rob_squash(rob_addr);
+        int id = ckpt_find(rob_addr);
+
+        if (id >= 0) {
+                if (rename_mode == RENAME_PRF)
+                        prf_restore(id);
+                else
+                        reg_restore(id);
+
+                recovery.stall = recovery.latency;
+                stats.ckpt_recoveries++;
+        } else {
+                for (int k = n; k > 0; k--) {
+                        tag_t e = (rob_addr + k) % recovery.rob_size;
+                        tag_t preg, prev;
+                        uint8_t rd;
+
+                        rob_read_dest(e, &rd);
+                        rob_read_rename(e, &preg, &prev);
+
+                        if (rename_mode == RENAME_PRF)
+                                prf_undo(rd, preg, prev);
+                        else
+                                reg_undo(rd, prev, prev != e && rob_busy(prev));
+                }
+
+                recovery.stall = (n + recovery.walk_width - 1) / recovery.walk_width;
+                if (recovery.stall < 1)
+                        recovery.stall = 1;
+                stats.walk_recoveries++;
+        }
+
+        // Checkpoints of the squashed branches are free
+        for (int i = 0; i < recovery.nb_ckpt; i++)
+                if (recovery.ckpt[i].busy && rob_age(recovery.ckpt[i].rob) > age)
+                        recovery.ckpt[i].busy = false;
+
+        stats.squashed += n;
+        stats.recovery_cycles += recovery.stall;
+        if (profiling())
+                prof_mispredict(rob_addr, stats.cycles, recovery.stall);
+
+        // Wrong path may have reached the end of the program, the slots lost
+        // behind it were bad speculation
+        stats.slots_empty[SLOT_BAD_SPEC] += topdown.halted;
+        topdown.halted = 0;
+        PC = pc;
+        halt = false;
+        trace_wait = false;
+}
+
+
+// Orders the CDB requests and grants the lanes, like hw/src/arbiter.vhd
+// round robin passes the token to the initiator after the last one granted
+static void cdb_arbitrate(void) {
+
+        for (int i = 0; i < cdb.nb_req; i++) {
+                struct cdb_req *r = &cdb.req[i];
+
+                if (cdb.lookahead && cdb.hold[r->init])
+                        r->prio = -1;
+                else if (cdb.policy == CDB_FIXED)
+                        r->prio = r->init;
+                else if (cdb.policy == CDB_ROUND_ROBIN)
+                        r->prio = (r->init - cdb.token - 1 + cdb.nb_init) % cdb.nb_init;
+                else
+                        r->prio = rob_age(r->rob);
+        }
+
+        // Insertion sort, ties go to the oldest instruction
+        for (int i = 1; i < cdb.nb_req; i++) {
+                struct cdb_req r = cdb.req[i];
+                int j = i - 1;
+
+                while (j >= 0 && (cdb.req[j].prio > r.prio ||
+                                (cdb.req[j].prio == r.prio && rob_age(cdb.req[j].rob) > rob_age(r.rob)))) {
+                        cdb.req[j + 1] = cdb.req[j];
+                        j--;
+                }
+                cdb.req[j + 1] = r;
+        }
+
+        for (int i = 0; i < cdb.nb_init; i++)
+                cdb.hold[i] = false;
+
+        // The look-ahead of an initiator is set when a second value is
+        // ready behind the one it puts on the bus
+        bool lsu_granted = false;
+        cdb.nb_active_lanes = 0;
+        for (int i = 0; i < cdb.nb_req; i++) {
+                struct cdb_req *r = &cdb.req[i];
+                struct cdb_data *l = &cdb.lane[cdb.nb_active_lanes];
+                int src = r->init < exu.nb_units ? (int)exu.units[r->init].type : CDB_LSU;
+
+                if (cdb.nb_active_lanes == cdb.nb_lanes) {
+                        if (r->load >= 0 && lsu_granted)
+                                cdb.hold[r->init] = cdb.lookahead;
+
+                        stats.cdb_stalls[src]++;
+                        continue;
+                }
+
+                if (r->load >= 0) {
+                        lsu_wb(r->load, &l->qr, &l->rob, &l->result);
+                        lsu_granted = true;
+                } else {
+                        struct exu_data *u = &exu.units[r->init];
+
+                        l->qr = u->ops[0].qr;
+                        l->rob = u->ops[0].rob;
+                        l->result = u->ops[0].result;
+                        exu_pop(u);
+
+                        cdb.hold[r->init] = cdb.lookahead && u->nb_ops && u->ops[0].cycle_left == 0;
+                }
+
+                l->valid = true;
+                stats.cdb_lane_busy[cdb.nb_active_lanes++]++;
+                cdb.token = r->init;
+        }
+}
+
+
 // Do in reverse order to simulate FF
 // 1. Propagate results in CBD structure
 // 2. Read ROB
@@ -361,9 +1554,27 @@ static int write_back(void) {
         // ---
         // READ CBD AND STORE IN ROB
         // ---
-        for(int i = 0; i < cdb.nb_lanes; i++)
-                if(cdb.lane[i].valid)
-                        rob_write(cdb.lane[i].qr, cdb.lane[i].result);
+        // In physical register mode the value is only written once, in the
+        // PRF, the ROB only needs to know the instruction is done
+        for(int i = 0; i < cdb.nb_lanes; i++) {
+                if(cdb.lane[i].valid) {
+                        if (rename_mode == RENAME_PRF) {
+                                prf_write(cdb.lane[i].qr, cdb.lane[i].result);
+                                rob_set_done(cdb.lane[i].rob);
+                        } else {
+                                rob_write(cdb.lane[i].rob, cdb.lane[i].result);
+                        }
+                        stats.value_writes++;
+                }
+        }
+
+        // Stores are done once they have their address and data
+        tag_t rob_addr;
+        while (lsu_store_ready(&rob_addr)) {
+                rob_set_done(rob_addr);
+                if (critical)
+                        crit_complete(rob_addr, stats.cycles);
+        }
 
         // ---
         // PUT UNIT RESULTS IN CDB
@@ -373,61 +1584,128 @@ static int write_back(void) {
         for (int i = 0; i < cdb.nb_lanes; i++)
                 cdb.lane[i].valid = 0;
 
-        // Check all EXU
-        exu.nb_done = 0;
+        // Branches are resolved as soon as they complete, the oldest
+        // mispredicted one redirects the frontend
+        int mp_rob = -1;
+        uint32_t mp_pc = 0;
         for(int i = 0; i < exu.nb_units; i++) {
-                if(exu.units[i].busy && exu.units[i].cycle_left == 0)
-                        exu.done_list[exu.nb_done++] = i;
-        }
-        //TODO Check LSU
+                struct exu_data *u = &exu.units[i];
 
-        // SELECT what unit -> cdb lane
-        if (exu.nb_done > cdb.nb_lanes)
-                cdb.nb_active_lanes = cdb.nb_lanes;
-        else
-                cdb.nb_active_lanes = exu.nb_done;
-
-        // TODO: mix between exu/lsu
-        // TODO: algorithm so the index selected is not always the first one
-        for(int i = 0; i < exu.nb_done; i++) {
-                int exu_index = exu.done_list[i];
-
-                // Store exu result in the CDB
-                cdb.lane[i] = (struct cdb_data) {
-                        .qr = exu.units[exu_index].qr,
-                        .result = exu.units[exu_index].result,
-                        .valid = true
-                };
+                for (int j = 0; j < u->nb_ops; j++) {
+                        struct exu_op *o = &u->ops[j];
+
+                        if (!o->branch || o->cycle_left != 0)
+                                continue;
 
-                // Clear the EXU
-                exu.units[exu_index].busy = false;
+                        o->branch = false;
+
+                        if (!o->mispredict) {
+                                ckpt_release(o->rob);
+                        } else if (mp_rob < 0 || rob_age(o->rob) < rob_age(mp_rob)) {
+                                mp_rob = o->rob;
+                                mp_pc = o->npc;
+                        }
+                }
         }
 
-        // Foward the results to EXB
-        for (int i = 0; i < exb.buf_size; i++) {
-                if(exb.buf[i].busy) {
-                        if(!exb.buf[i].rj) {
-                                for(int j = 0; j < cdb.nb_lanes; j++) {
-                                        if(cdb.lane[j].valid) {
-                                                if (exb.buf[i].qj == cdb.lane[j].qr) {
-                                                        exb.buf[i].vj = cdb.lane[j].result;
-                                                        exb.buf[i].rj = true;
-                                                        break;
-                                                }
-                                        }
+        if (mp_rob >= 0) {
+                if (critical)
+                        crit_redirect(mp_rob, stats.cycles);
+                recover(mp_rob, mp_pc);
+                ckpt_release(mp_rob);
+                stats.mispredicts++;
+        }
+
+        // Check all EXU, ops without a destination complete without the CDB
+        // A store address can reveal a load that executed too early
+        int vl_rob = -1;
+        uint32_t vl_pc = 0;
+        for(int i = 0; i < exu.nb_units; i++) {
+                struct exu_data *u = &exu.units[i];
+
+                while(u->nb_ops && u->ops[0].cycle_left == 0 && !u->ops[0].wb) {
+                        struct exu_op *o = &u->ops[0];
+                        tag_t l_rob;
+                        uint32_t l_pc;
+
+                        if (u->type == UNIT_AGU) {
+                                if (!o->store)
+                                        lsu_set_load_addr(o->lsq, o->result);
+                                else if (lsu_set_store_addr(o->lsq, o->result, &l_rob, &l_pc) &&
+                                                (vl_rob < 0 || rob_age(l_rob) < rob_age(vl_rob))) {
+                                        vl_rob = l_rob;
+                                        vl_pc = l_pc;
                                 }
+
+                                if (o->lsq2 >= 0)
+                                        lsu_set_load_addr(o->lsq2, o->result + 4);
+                        } else {
+                                rob_set_done(o->rob);
+                                if (critical)
+                                        crit_complete(o->rob, stats.cycles);
                         }
 
-                        if(!exb.buf[i].rk) {
-                                for(int j = 0; j < cdb.nb_lanes; j++) {
-                                        if(cdb.lane[j].valid) {
-                                                if (exb.buf[i].qk == cdb.lane[j].qr) {
-                                                        exb.buf[i].vk = cdb.lane[j].result;
-                                                        exb.buf[i].rk = true;
-                                                        break;
-                                                }
-                                        }
-                                }
+                        exu_pop(u);
+                }
+        }
+
+        // The load and everything younger is fetched again, the store sets
+        // were trained by the LSU
+        if (vl_rob >= 0) {
+                if (critical)
+                        crit_redirect(vl_rob, stats.cycles);
+                recover((vl_rob + recovery.rob_size - 1) % recovery.rob_size, vl_pc);
+                stats.violations++;
+        }
+
+        cdb.nb_req = 0;
+        for(int i = 0; i < exu.nb_units; i++) {
+                struct exu_data *u = &exu.units[i];
+
+                if(u->nb_ops && u->ops[0].cycle_left == 0)
+                        cdb.req[cdb.nb_req++] = (struct cdb_req) {
+                                .init = i,
+                                .load = -1,
+                                .rob = u->ops[0].rob,
+                        };
+        }
+
+        // Loads that got their data request the bus through the LSU
+        for (int i = lsu_wb_next(0, &rob_addr); i >= 0; i = lsu_wb_next(i + 1, &rob_addr))
+                cdb.req[cdb.nb_req++] = (struct cdb_req) {
+                        .init = exu.nb_units,
+                        .load = i,
+                        .rob = rob_addr,
+                };
+
+        // Requests that did not get a lane keep their result until next cycle
+        cdb_arbitrate();
+
+        // Forward the results to EXB and to the stores waiting on their data
+        for (int j = 0; j < cdb.nb_lanes; j++) {
+                if(!cdb.lane[j].valid)
+                        continue;
+
+                lsu_cdb(cdb.lane[j].qr, cdb.lane[j].result);
+                if (critical)
+                        crit_complete(cdb.lane[j].rob, stats.cycles);
+
+                for (int i = 0; i < exb.buf_size; i++) {
+                        if(!exb.buf[i].busy)
+                                continue;
+
+                        if(!exb.buf[i].rj && exb.buf[i].qj == cdb.lane[j].qr) {
+                                exb.buf[i].vj = cdb.lane[j].result;
+                                exb.buf[i].rj = true;
+                                if (critical)
+                                        crit_operand(exb.buf[i].rob, cdb.lane[j].rob, stats.cycles);
+                        }
+
+                        if(!exb.buf[i].rk && exb.buf[i].qk == cdb.lane[j].qr) {
+                                exb.buf[i].vk = cdb.lane[j].result;
+                                exb.buf[i].rk = true;
+                                if (critical)
+                                        crit_operand(exb.buf[i].rob, cdb.lane[j].rob, stats.cycles);
                         }
                 }
         }
@@ -436,42 +1714,105 @@ static int write_back(void) {
 }
 
 
-static void commit(void) {
+// Commits the oldest entry of the ROB, returns 1 if it was done
+static int commit(void) {
         int32_t result;
-        uint8_t rd, rob_addr;
+        uint8_t rd;
+        tag_t rob_addr;
+
+        // Store is written to memory once committed, it holds the commit
+        // while it can't be written
+        if (rob_head(&rob_addr) && lsu_commit_store(rob_addr) < 0) {
+                stats.store_stalls++;
+                return 0;
+        }
 
         if (rob_commit(&rob_addr, &rd, &result)) {
+                stats.instret += rob_fused(rob_addr) ? 2 : 1;
+                stats.slots_retiring += topdown.rob[rob_addr].slot;
+                if (profile)
+                        prof_retire(rob_addr);
+                if (critical)
+                        crit_commit(rob_addr, stats.cycles);
+
+                // Only the architectural map changes, the value already is
+                // in the PRF
+                if (rename_mode == RENAME_PRF) {
+                        tag_t preg, prev;
+                        rob_read_rename(rob_addr, &preg, &prev);
+                        prf_commit(rd, preg, prev);
+                        return 1;
+                }
+
                 // Propagate result from ROB to REG
-                reg_write_data(rd, result);
+                if (reg_commit(rd, rob_addr, result))
+                        stats.value_writes++;
 
                 // Foward result to EXB
                 for (int i = 0; i < exb.buf_size; i++) {
                         if (exb.buf[i].busy) {
-                                if (!exb.buf[i].rj) {
-                                        if (exb.buf[i].qj == rob_addr) {
-                                                exb.buf[i].vj = result;
-                                                exb.buf[i].rj = true;
-                                                break;
-                                        }
+                                if (!exb.buf[i].rj && exb.buf[i].qj == rob_addr) {
+                                        exb.buf[i].vj = result;
+                                        exb.buf[i].rj = true;
                                 }
 
-                                if (!exb.buf[i].rk) {
-                                        if (exb.buf[i].qk == rob_addr) {
-                                                exb.buf[i].vk = result;
-                                                exb.buf[i].rk = true;
-                                                break;
-                                        }
+                                if (!exb.buf[i].rk && exb.buf[i].qk == rob_addr) {
+                                        exb.buf[i].vk = result;
+                                        exb.buf[i].rk = true;
                                 }
                         }
                 }
+
+                return 1;
+        }
+
+        return 0;
+}
+
+
+// Bits of storage needed for values, tags and maps of the register
+// organization, used to compare the area of both modes
+static uint64_t storage_bits(const struct engine_parameters *param) {
+        int abits = clog2(param->reg_size);
+
+        if (param->rename_mode == RENAME_PRF) {
+                int pbits = clog2(param->prf_size);
+
+                return (uint64_t)param->prf_size * (32 + 1)            // PRF values + ready
+                        + 2 * param->reg_size * pbits                  // Speculative & committed maps
+                        + param->prf_size * pbits                      // Free list
+                        + param->rob_size * (abits + 2 * pbits + 1)    // ROB: rd, preg, prev, done
+                        + param->nb_ckpt * (param->reg_size + 1) * pbits; // Checkpoints of map & free head
         }
+
+        int tbits = clog2(param->rob_size);
+
+        return (uint64_t)param->rob_size * (abits + 32 + 1 + tbits)     // ROB: rd, value, done, prev
+                + param->reg_size * (32 + tbits + 1)                    // REG: value, src, dirty
+                + param->nb_ckpt * param->reg_size * (tbits + 1);       // Checkpoints of src & dirty
 }
 
 
-// TODO: Determine file extension: .txt = str like else elf file
-static int load_program(const char *fn) {
+// An ELF file, linked or an object, else a .txt with one instruction per line
+// An executable starts at its entry point, an object file or an image at 0
+static int load_program(const char *fn, int mem_size, uint32_t *entry) {
+        struct elf_file elf;
+
+        *entry = 0;
+        if (!elf_open(fn, &elf)) {
+                int retval = elf_load(&elf, mem_size, mem_write);
+
+                if (retval == EFBIG)
+                        fprintf(stderr, "A section of %s doesn't fit in %d bytes of memory\n", fn, mem_size);
+                else if (retval == EINVAL)
+                        fprintf(stderr, "%s has more than one code section, link it first\n", fn);
+                if (elf.e.type == ET_EXEC)
+                        *entry = elf.e.entry;
+
+                elf_close(&elf);
+                return retval;
+        }
 
-        // FIXME: only support .txt for now
         FILE * f = fopen(fn, "r");
         if (!f)
                 return -1;
@@ -498,43 +1839,248 @@ static int load_program(const char *fn) {
 }
 
 
+// Functions of the profile, from the symbol table of an ELF file
+static int load_symbols(const char *fn) {
+        struct elf_file elf;
+        struct elf_symbol *sym;
+        int nb_sym, retval;
+
+        if ((retval = elf_open(fn, &elf)))
+                return retval;
+
+        retval = elf_symbols(&elf, &sym, &nb_sym);
+        elf_close(&elf);
+        if (retval)
+                return retval;
+
+        // Every cycle is then charged to <unknown>
+        if (!nb_sym)
+                fprintf(stderr, "Warning: no functions nor code labels in %s, the function profile is empty\n", fn);
+
+        prof_symbols(sym, nb_sym);
+
+        return 0;
+}
+
+
 // ---
 // GLOBAL FUNCTIONS
 // ---
 void engine_destroy(void) {
 
+        func_destroy(&func);
+        ring_destroy(&ring);
+        frontend = FRONTEND_INTEGRATED;
+
         exb_destroy();
         rob_destroy();
         reg_destroy();
+        prf_destroy();
+        lsu_destroy();
+        mdp_destroy();
+        cache_destroy();
         exu_destroy();
         cdb_destroy();
         mem_destroy();
+
+        if (recovery.ckpt)
+                free(recovery.ckpt);
+
+        recovery = (struct recovery) {0};
+
+        if (topdown.rob)
+                free(topdown.rob);
+
+        topdown = (struct topdown) {0};
+
+        if (roi.dumps)
+                free(roi.dumps);
+
+        roi = (struct roi) {0};
+
+        prof_destroy();
+        profile = false;
+        crit_destroy();
+        critical = false;
+        wave_destroy();
+        hotspots = 0;
+        functions = PROF_NONE;
 }
 
 
 int engine_init(const struct engine_parameters *param) {
         int retval;
 
+        PC = 0;
+        next_pc = 0;
+        halt = false;
+        stats = (struct engine_stats) {0};
+
+        if (param->nb_ckpt < 0 || param->recover_latency < 1 || param->walk_width < 1 || param->dispatch_width < 1)
+                return -1;
+
+        if (param->cdb_size < 1 || param->cdb_size > CDB_MAX_LANES)
+                return -1;
+
+        // Write combining entries are L1D lines
+        int line = param->l1d.line_size;
+        if (param->wcb_size < 0 || (param->wcb_size && (param->wcb_drain < 1 || line < 4 || (line & (line - 1)))))
+                return -1;
+
+        if (param->amo_latency < 0)
+                return -1;
+
+        // Every ROB entry and physical register needs its own tag
+        if ((uint64_t)param->rob_size > TAG_COUNT || (uint64_t)param->prf_size > TAG_COUNT) {
+                fprintf(stderr, "%d bit tags can't name %d ROB entries or %d physical registers, rebuild with a larger TAG_BITS\n",
+                        TAG_BITS, param->rob_size, param->prf_size);
+                return EINVAL;
+        }
+
+        // Misprediction recovery
+        recovery = (struct recovery) {
+                .rob_size = param->rob_size,
+                .latency = param->recover_latency,
+                .walk_width = param->walk_width,
+                .stall = 0,
+                .nb_ckpt = param->nb_ckpt,
+                .ckpt = calloc(param->nb_ckpt + 1, sizeof(*recovery.ckpt)),
+        };
+
+        if (!recovery.ckpt) {
+                retval = ENOMEM;
+                goto CLEANUP;
+        }
+
+        topdown = (struct topdown) {.rob = calloc(param->rob_size, sizeof(*topdown.rob))};
+        if (!topdown.rob) {
+                retval = ENOMEM;
+                goto CLEANUP;
+        }
+
         // Create exec buffers
         if((retval = exb_create(param->exb_size))) goto CLEANUP;
 
         // Create ROB
         if((retval = rob_create(param->rob_size))) goto CLEANUP;
 
-        // Create registers
-        if((retval = reg_create(param->reg_size))) goto CLEANUP;
+        // Create registers, either the architectural register file or the
+        // merged physical register file
+        rename_mode = param->rename_mode;
+        select_policy = param->select_policy;
+        fusion = param->fusion;
+        dispatch_width = param->dispatch_width;
+        select_seed = 0x749;
+
+        if (rename_mode == RENAME_PRF) {
+                if((retval = prf_create(param->prf_size, param->reg_size, param->nb_ckpt))) goto CLEANUP;
+        } else {
+                if((retval = reg_create(param->reg_size, param->nb_ckpt))) goto CLEANUP;
+        }
+
+        stats.storage_bits = storage_bits(param);
 
-        // Create exec units, LSU and BRU
-        if((retval = exu_create(param->nb_units))) goto CLEANUP;
+        // Hotspots, indexed by ROB entry until they commit
+        hotspots = param->profile;
+        functions = param->functions;
+        profile = hotspots || functions != PROF_NONE;
+        if (profile && (retval = prof_create(param->rob_size))) goto CLEANUP;
+
+        // Critical path, the nodes in flight are indexed by ROB entry
+        critical = param->critical;
+        if (critical && (retval = crit_create(param->rob_size))) goto CLEANUP;
+
+        if (functions != PROF_NONE) {
+                const char *fn = param->symbols ? param->symbols : param->program;
+
+                if ((retval = load_symbols(fn))) {
+                        fprintf(stderr, "No symbols in %s\n", fn);
+                        goto CLEANUP;
+                }
+
+                // Every core of a cluster has its own file
+                if (param->folded && param->nb_cores > 1)
+                        snprintf(folded, sizeof(folded), "%s.%d", param->folded, param->core);
+                else if (param->folded)
+                        snprintf(folded, sizeof(folded), "%s", param->folded);
+        }
+
+        // Create exec units, AGU and BRU pools
+        if((retval = exu_create(param->pool))) goto CLEANUP;
+
+        // Create LSU
+        if((retval = lsu_create(param->lb_size, param->sb_size, param->mdp_policy,
+                                param->wcb_size, param->wcb_drain, param->l1d.line_size,
+                                param->mem_latency + param->amo_latency))) goto CLEANUP;
+        if((retval = mdp_create(param->ssit_size, param->lfst_size))) goto CLEANUP;
+
+        // The next level answers in mem_latency cycles
+        struct cache_param l1d = param->l1d;
+        l1d.miss_latency = param->mem_latency;
+        l1d.core = param->core;
+        if((retval = cache_create(&l1d))) goto CLEANUP;
 
         // Create cdb
-        if((retval = cdb_create(param->cdb_size))) goto CLEANUP;
+        if((retval = cdb_create(param->cdb_size, param->cdb_policy, param->cdb_lookahead,
+                                exu.nb_units, param->lb_size))) goto CLEANUP;
 
         // Create Memory
         if((retval = mem_create(param->mem_size))) goto CLEANUP;
 
-        // Load Program into memory
-        if((retval = load_program(param->program))) goto CLEANUP;
+        // Load Program into memory, a replayed trace needs no program
+        if (param->frontend != FRONTEND_REPLAY)
+                if((retval = load_program(param->program, param->mem_size, &PC))) goto CLEANUP;
+
+        // Cores of a cluster only share their stores once loaded, the
+        // firmware tells them apart by their hart id in a0, a1 is the
+        // number of cores
+        mem_set_core(param->core);
+        csr_init(param->core);
+        if (rename_mode == RENAME_PRF) {
+                prf_write(REG_X10, param->core);
+                prf_write(REG_X11, param->nb_cores);
+        } else {
+                reg_write_data(REG_X10, param->core);
+                reg_write_data(REG_X11, param->nb_cores);
+        }
+
+        // The functional thread runs on its own copy of the program, the
+        // memory dependences are only known once the trace is consumed so
+        // a load can't be replayed
+        trace_wait = false;
+        if (param->frontend != FRONTEND_INTEGRATED) {
+                if (param->mdp_policy != MDP_CONSERVATIVE || param->ring_size < 2) {
+                        fprintf(stderr, "A decoupled frontend needs conservative memory dependences and a ring of 2 records or more\n");
+                        retval = EINVAL;
+                        goto CLEANUP;
+                }
+
+                if((retval = ring_create(&ring, param->ring_size))) goto CLEANUP;
+
+                if (param->frontend == FRONTEND_REPLAY) {
+                        if((retval = func_replay(&func, param->trace))) goto CLEANUP;
+                } else {
+                        if((retval = func_create(&func, param->mem_size))) goto CLEANUP;
+                        func.pc = PC;
+                        func.x[REG_X10] = param->core;
+                        func.x[REG_X11] = param->nb_cores;
+                        if (param->frontend == FRONTEND_RECORD)
+                                if((retval = func_record(&func, param->trace))) goto CLEANUP;
+                }
+
+                if((retval = func_start(&func, &ring))) goto CLEANUP;
+                frontend = param->frontend;
+        }
+
+        // A fast-forwarded program is outside the regions until its first
+        // ROI_BEGIN, the functional model runs on the engine memory
+        roi = (struct roi) {.mode = param->roi, .fast = param->roi == ROI_FAST};
+        roi.ff.pc = PC;
+        roi.ff.x[REG_X10] = param->core;
+        roi.ff.x[REG_X11] = param->nb_cores;
+
+        // Waveforms of the state over a window of cycles
+        if (param->vcd && (retval = wave_create(param))) goto CLEANUP;
 
         return 0;
 
@@ -545,24 +2091,170 @@ CLEANUP:
 
 
 int engine_run(void) {
+        // The run stops with the functional thread if its trace failed
+        if (frontend != FRONTEND_INTEGRATED && atomic_load_explicit(&func.done, memory_order_acquire) && func.error)
+                return -func.error;
+
+        // The L1D misses are counted with the other events
+        if (profile)
+                prof_enable(profiling());
+
+        // Outside the regions the functional model runs one instruction
+        // per cycle
+        if (roi.fast) {
+                if (!halt)
+                        fast_forward();
+
+                stats.cycles++;
+                cache_tick();
+
+                return halt;
+        }
 
-        mem_read(PC, &instruction, sizeof(instruction));
+        // The cycle is charged to the oldest instruction, or to the next
+        // one while the ROB is empty
+        bool profiled = profiling();
+        tag_t head;
+
+        if (profiled && rob_head(&head))
+                prof_count_rob(head, PROF_CYCLES, 1);
+        else if (profiled)
+                prof_count(PC, PROF_CYCLES, 1);
 
         // Backend
-        commit();
+        // Retire as many ops per cycle as can be dispatched
+        int retired = 0;
+        while (retired < dispatch_width && commit())
+                retired++;
+
+        if (profiled && !retired && rob_head(&head))
+                prof_count_rob(head, PROF_HEAD_STALLS, 1);
+
         write_back();
         execute();
         issue();
-        dispatch();
+
+        // Ops left in the EXB wait for an operand or a unit
+        for (int i = 0; profiled && i < exb.buf_size; i++)
+                if (exb.buf[i].busy)
+                        prof_count_rob(exb.buf[i].rob, PROF_EXB_WAITS, 1);
 
         // Frontend
+        // PC logic: only move on once the instruction has been dispatched,
+        // the frontend waits while a misprediction is being recovered
+        int slots = 0;
+
+        topdown.stall = SLOT_FRONTEND;
+        if (recovery.stall != 0) {
+                recovery.stall--;
+                topdown.stall = SLOT_BAD_SPEC;
+        } else {
+                group_writes = 0;
+
+                for (int i = 0; i < dispatch_width && !halt; i++) {
+                        if (frontend != FRONTEND_INTEGRATED) {
+                                if (trace_wait) {
+                                        stats.trace_waits++;
+                                        topdown.stall = SLOT_BAD_SPEC;
+                                        break;
+                                }
+
+                                // The next record is only a fusion candidate
+                                // if it follows in memory
+                                trace[0] = ring_peek(&ring, 0);
+                                trace[1] = ring_peek(&ring, 1);
+                                PC = trace[0]->pc;
+                                instruction = trace[0]->inst;
+                                next_instruction = trace[1]->pc == PC + 4 ? trace[1]->inst : 0;
+                        } else {
+                                mem_read(PC, &instruction, sizeof(instruction));
+                                mem_read(PC + 4, &next_instruction, sizeof(next_instruction));
+                        }
+
+                        int r = dispatch();
+                        if (r < 0)
+                                break;
+                        slots++;
+
+                        // Nothing to fetch until the branch is resolved
+                        if (frontend != FRONTEND_INTEGRATED) {
+                                trace_wait = next_pc != trace[trace_used - 1]->npc;
+                                ring_pop(&ring, trace_used);
+                                if (trace_wait) {
+                                        topdown.stall = SLOT_BAD_SPEC;
+                                        break;
+                                }
+                        }
+
+                        PC = next_pc;
+
+                        if (r > 0)
+                                break;
+                }
+        }
+
+        // The slots left are charged to what stopped the dispatch, a halt
+        // only ends the program once it commits
+        if (halt && topdown.stall == SLOT_FRONTEND)
+                topdown.halted += dispatch_width - slots;
+        else
+                stats.slots_empty[topdown.stall] += dispatch_width - slots;
+
+        if (wave.on && vcd_window(stats.cycles))
+                wave_sample(slots);
 
         //reg_print();
         //printf("\n");
 
-        // PC logic
-        PC += 4;
+        stats.cycles++;
+        cache_tick();
+
+        // Program is done once every dispatched instruction has committed
+        if (halt && rob_empty() && lsu_drained())
+                return 1;
 
         return 0;
 }
 
+
+void engine_get_stats(struct engine_stats *s) {
+        roi_stats(s);
+}
+
+
+int engine_get_dump(int i, struct engine_stats *s) {
+        if (i < 0 || i >= roi.nb_dumps)
+                return -1;
+
+        *s = roi.dumps[i];
+
+        return 0;
+}
+
+
+void engine_profile(FILE *f) {
+        if (hotspots)
+                prof_report(f, hotspots);
+
+        // The path of a region still open ends at the last commit
+        if (critical) {
+                if (roi.mode == ROI_OFF || roi.inside)
+                        crit_stop();
+                crit_report(f);
+        }
+
+        if (functions == PROF_GPROF) {
+                prof_functions(f);
+        } else if (functions == PROF_FOLDED) {
+                FILE *out = fopen(folded, "w");
+
+                if (!out) {
+                        fprintf(stderr, "Could not write the folded stacks to %s\n", folded);
+                        return;
+                }
+
+                prof_folded(out);
+                fclose(out);
+                fprintf(f, "folded    : %s\n", folded);
+        }
+}
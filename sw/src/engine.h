@@ -5,23 +5,204 @@
 #include "rob.h"
 #include "decoder.h"
 #include "reg.h"
+#include "prf.h"
 #include "unit.h"
 #include "mem.h"
+#include "lsu.h"
+#include "fusion.h"
+#include "mdp.h"
+#include "cache.h"
+#include "ring.h"
+#include "func.h"
+#include "csr.h"
+#include "prof.h"
+#include "crit.h"
+#include "vcd.h"
+
+enum rename_mode {
+        RENAME_ROB,     // Values are carried by the ROB and copied in the regfile on commit
+        RENAME_PRF      // Merged physical register file with rename map and free list
+};
+
+enum select_policy {
+        SELECT_OLDEST,          // Oldest ready entry first, age matrix like hw/src/dispatcher.vhd
+        SELECT_POSITION,        // Lowest EXB index first
+        SELECT_RANDOM,          // Pseudo random order
+        SELECT_CRITICAL         // Entry with the most waiting dependents first
+};
+
+enum cdb_policy {
+        CDB_FIXED,              // Lowest initiator first, units then the LSU
+        CDB_ROUND_ROBIN,        // Token passed after the last initiator granted, like hw/src/arbiter.vhd
+        CDB_OLDEST              // Oldest instruction first
+};
+
+enum frontend {
+        FRONTEND_INTEGRATED,    // Fetch from mem and execute down the predicted path
+        FRONTEND_DECOUPLED,     // Follow the trace of a functional frontend thread
+        FRONTEND_RECORD,        // Decoupled and saves the trace to a file
+        FRONTEND_REPLAY         // Follow a saved trace, the program is not executed
+};
+
+// Region of interest markers, hints that the ISA leaves to the
+// implementation (addi x0, x0, imm) so the program runs unchanged elsewhere
+enum roi_mode {
+        ROI_OFF,                // Markers are nops, the whole program is measured
+        ROI_STATS,              // Statistics only count inside the regions
+        ROI_FAST                // Outside the regions the program is fast-forwarded by the functional model
+};
+
+#define ROI_BEGIN       0x00100013      // Starts counting
+#define ROI_END         0x00200013      // Stops counting, fast-forwards until the next ROI_BEGIN
+#define ROI_DUMP        0x00300013      // Saves the counters so far
+#define ROI_RESET       0x00400013      // Zeroes the counters
+
+#define CDB_MAX_LANES   8
+#define CDB_LSU         NB_UNIT_TYPES   // Stall counter of the loads
 
 struct engine_parameters {
         int mem_size;
         int exb_size;
         int rob_size;
         int reg_size;
+        enum rename_mode rename_mode;
+        int prf_size;
         int cdb_size;
-        int nb_units;
+        enum cdb_policy cdb_policy;
+        bool cdb_lookahead;     // Initiators with a second value ready keep the bus priority
+        int dispatch_width;     // Instructions dispatched per cycle
+        struct unit_pool_param pool[NB_UNIT_TYPES];
+        enum select_policy select_policy;
+        int lb_size;
+        int sb_size;
+        int mem_latency;
+        struct cache_param l1d; // Data cache and MSHRs, the miss latency is mem_latency
+        int wcb_size;           // Post commit write combining entries, 0 writes stores at commit
+        int wcb_drain;          // Entries drained to the L1D per cycle
+        int amo_latency;        // Cycles of an atomic at the memory side, after mem_latency
+        enum mdp_policy mdp_policy;     // When loads may bypass older stores without an address
+        int ssit_size;          // Store set id table entries, indexed by PC
+        int lfst_size;          // Last fetched store table entries, one per store set
+        int nb_ckpt;            // Rename checkpoints, branches without one recover by walking the ROB
+        int recover_latency;    // Cycles to restore a checkpoint
+        int walk_width;         // ROB entries undone per cycle when walking back
+        enum frontend frontend;
+        int ring_size;          // Trace records buffered ahead of the timing model
+        char *trace;            // Trace file recorded or replayed
+        uint32_t fusion;        // Whitelist of the fusion patterns, bit mask of enum fusion_pattern
+        int core;               // Hart id, in a0 at reset
+        int nb_cores;           // Cores sharing the memory, in a1 at reset
+        enum roi_mode roi;
+        int profile;            // Addresses in the hotspot report, -1 for all, 0 doesn't profile
+        enum prof_format functions;
+        char *folded;           // File of the folded stacks
+        char *symbols;          // ELF file with the functions, the program by default
+        bool critical;          // Follows the critical path of the dependence graph
+        char *vcd;              // File of the waveforms, NULL doesn't dump them
+        uint64_t vcd_first;     // Cycles written to the waveforms
+        uint64_t vcd_last;
         char *program;
 };
 
+// Top-down classes of the dispatch slots left empty, the slots of the ops
+// are retiring or bad speculation once they commit or are squashed
+enum slot_class {
+        SLOT_FRONTEND,          // Nothing to dispatch: end of a fetch group or of the program
+        SLOT_BAD_SPEC,          // Frontend waiting on a misprediction
+        SLOT_MEMORY,            // Backend full behind a load, store or atomic
+        SLOT_CORE,              // Backend full behind any other op
+        NB_SLOT_CLASSES
+};
+
+struct engine_stats {
+        uint64_t cycles;  // Simulated clock cycles
+        uint64_t instret; // Committed instructions
+
+        // Dispatch
+        uint64_t dispatched;    // Ops dispatched, a fused pair counts once
+        uint64_t group_deps;    // Sources produced by an older op of the same dispatch group
+        uint64_t rob_full;      // Cycles dispatch stopped on a full ROB
+        uint64_t exb_full;      // ... on a full execution buffer
+        uint64_t lsq_full;      // ... on a full load or store buffer
+        uint64_t prf_full;      // ... without a free physical register
+
+        // Top-down, dispatch_width slots per cycle
+        uint64_t slots_retiring;                // Slots of the committed ops
+        uint64_t slots_empty[NB_SLOT_CLASSES];  // Slots left empty, per reason
+
+        // Register organization
+        uint64_t value_writes;  // Result values written in ROB, REG or PRF
+        uint64_t reads_reg;     // Operands read from REG or PRF at dispatch
+        uint64_t reads_cdb;     // Operands bypassed from the CDB at dispatch
+        uint64_t reads_rob;     // Operands read from the ROB at dispatch
+        uint64_t storage_bits;  // Storage for values, tags and maps
+
+        // Unit pools
+        uint64_t pool_issued[NB_UNIT_TYPES];    // Ops issued to the pool
+        uint64_t pool_stalls[NB_UNIT_TYPES];    // Ready ops that found no free unit of the pool
+
+        // Common data bus
+        uint64_t cdb_lane_busy[CDB_MAX_LANES];  // Cycles the lane carried a result
+        uint64_t cdb_stalls[NB_UNIT_TYPES + 1]; // Results held back by the arbiter, per pool and LSU
+
+        // Branches
+        uint64_t branches;              // Dispatched branches that can mispredict
+        uint64_t mispredicts;
+        uint64_t ckpt_misses;           // Branches dispatched with every checkpoint in use
+        uint64_t ckpt_recoveries;       // Mispredicts recovered from a checkpoint
+        uint64_t walk_recoveries;       // Mispredicts recovered by walking back the ROB
+        uint64_t recovery_cycles;       // Cycles the frontend waited on recoveries
+        uint64_t squashed;              // Wrong path instructions removed from the ROB
+        uint64_t trace_waits;           // Cycles a decoupled frontend waited for a redirect
+        uint64_t trace_records;         // Records of the trace file, once it is complete
+        uint64_t trace_bytes;
+
+        // Memory dependences
+        uint64_t store_stalls;          // Commit cycles lost to a store that could not be written
+        uint64_t wcb_stores;            // Committed stores that entered the write combining buffer
+        uint64_t wcb_coalesced;         // Stores merged in an entry already in the buffer
+        uint64_t wcb_drained;           // Entries written to the L1D
+        uint64_t wcb_drain_stalls;      // Cycles the oldest entry waited for an MSHR
+        uint64_t wcb_forwards;          // Loads that read bytes still in the buffer
+        uint64_t loads_speculated;      // Loads executed before the address of an older store
+        uint64_t loads_waited;          // Loads held back by their store set
+        uint64_t violations;            // Ordering violations, the load and younger are replayed
+        uint64_t atomics;               // LR, SC and AMOs performed
+        uint64_t atomic_cycles;         // Cycles from the start of the atomics to their result
+        uint64_t sc_failures;           // SC that lost their reservation
+
+        // Data cache and prefetchers
+        struct cache_stats l1d;
+
+        // Macro-op fusion
+        uint64_t fusion_hits[NB_FUSIONS];       // Pairs dispatched as a single op
+
+        // Regions of interest, counted over the whole program
+        uint64_t roi_regions;           // ROI_BEGIN markers reached
+        uint64_t roi_dumps;             // ROI_DUMP markers reached
+        uint64_t fast_forwarded;        // Instructions run by the functional model, outside the regions
+};
+
 int engine_init(const struct engine_parameters *param);
 
 void engine_destroy(void);
 
+/* \fn engine_run
+ * \return 0 while the program is running, 1 once it has halted and the
+ *         backend has drained, -errno if the trace of a decoupled frontend
+ *         could not be read or written
+ * \brief Simulates one clock cycle
+ */
 int engine_run(void);
 
+// Statistics of the regions of interest, of the whole program without them
+void engine_get_stats(struct engine_stats *s);
+
+// Statistics saved by the ROI_DUMP marker i, returns -1 past the last one
+int engine_get_dump(int i, struct engine_stats *s);
+
+// Prints the hotspots, the functions and the critical path of the regions
+// of interest, if profiled. The folded stacks go to their own file
+void engine_profile(FILE *f);
+
 #endif
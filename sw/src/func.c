@@ -0,0 +1,280 @@
+#include "func.h"
+#include "decoder.h"
+#include "unit.h"
+#include "mem.h"
+#include <sched.h>
+
+
+// Without a private copy the program runs on the engine memory
+static uint32_t load(struct func *f, uint32_t addr, uint8_t funct3) {
+        uint32_t v = 0;
+        int n = 1 << (funct3 & 0x3);
+
+        if (!f->mem)
+                mem_read(addr, &v, n);
+
+        for (int i = 0; i < n && f->mem; i++)
+                v |= (uint32_t)f->mem[(addr + i) % f->mem_size] << (8 * i);
+
+        switch (funct3) {
+                case FUNCT3_LB: return (int8_t)v;
+                case FUNCT3_LH: return (int16_t)v;
+                default:        return v;
+        }
+}
+
+
+static void store(struct func *f, uint32_t addr, uint8_t funct3, uint32_t v) {
+        int n = 1 << (funct3 & 0x3);
+
+        if (!f->mem)
+                mem_write(addr, &v, n);
+
+        for (int i = 0; i < n && f->mem; i++)
+                f->mem[(addr + i) % f->mem_size] = v >> (8 * i);
+}
+
+
+int func_create(struct func *f, int mem_size) {
+        *f = (struct func) {0};
+
+        f->mem = malloc(mem_size);
+        f->mem_size = mem_size;
+
+        if (!f->mem)
+                return ENOMEM;
+
+        mem_read(0, f->mem, mem_size);
+
+        return 0;
+}
+
+
+static int open_trace(struct trace_file **t, const char *fn, bool write) {
+        int retval;
+
+        if (!(*t = malloc(sizeof(**t))))
+                return ENOMEM;
+
+        if ((retval = trace_open(*t, fn, write))) {
+                free(*t);
+                *t = NULL;
+        }
+
+        return retval;
+}
+
+
+static void close_trace(struct trace_file **t) {
+        if (!*t)
+                return;
+
+        trace_close(*t);
+        free(*t);
+        *t = NULL;
+}
+
+
+int func_replay(struct func *f, const char *fn) {
+        *f = (struct func) {0};
+
+        return open_trace(&f->in, fn, false);
+}
+
+
+int func_record(struct func *f, const char *fn) {
+        return open_trace(&f->out, fn, true);
+}
+
+
+void func_destroy(struct func *f) {
+        func_stop(f);
+
+        close_trace(&f->in);
+        close_trace(&f->out);
+
+        if (f->mem)
+                free(f->mem);
+
+        f->mem = NULL;
+}
+
+
+int func_step(struct func *f, struct trace_inst *t) {
+        uint32_t inst = load(f, f->pc, FUNCT3_LW);
+
+        *t = (struct trace_inst) {
+                .pc = f->pc,
+                .inst = inst,
+                .addr = 0,
+                .npc = f->pc + 4,
+        };
+
+        struct inst_field i = decode(inst);
+
+        if (inst == 0 || (i.opcode == OP_SYSTEM && i.funct3 == FUNCT3_PRIV)) {
+                f->halt = true;
+                return 0;
+        }
+
+        int32_t a = f->x[i.rs1];
+        int32_t b = f->x[i.rs2];
+        int32_t r = 0;
+        int16_t f10;
+
+        // Same operation encoding as the dispatch of the engine
+        switch (i.opcode) {
+                case OP_IMM:
+                        f10 = i.funct3;
+                        if (f10 == FUNCT3_SL || f10 == FUNCT3_SR) {
+                                if (i.immediate & 0x400)
+                                        f10 = F10_SRA;
+                                i.immediate &= 0x1F;
+                        }
+                        r = alu_exec(f10, a, i.immediate);
+                        break;
+                case OP_LUI:
+                        r = i.immediate;
+                        break;
+                case OP_AUIPC:
+                        r = f->pc + i.immediate;
+                        break;
+                case OP_LOAD:
+                        t->addr = a + i.immediate;
+                        r = load(f, t->addr, i.funct3);
+                        break;
+                case OP_STORE:
+                        t->addr = a + i.immediate;
+                        store(f, t->addr, i.funct3, b);
+                        break;
+                // Without a timing model every CSR reads the instructions
+                // executed so far, the engine reads the exact counters
+                case OP_SYSTEM:
+                        r = f->instret;
+                        break;
+                case OP_AMO:
+                        t->addr = a & ~3;
+                        if (!f->mem) {
+                                // The cores of a cluster perform their
+                                // atomics at the end of the quantum
+                                uint32_t v;
+                                if (!(f->amo_wait ? mem_amo_done(&v) : mem_amo(i.funct7 >> 2, t->addr, b, &v))) {
+                                        f->amo_wait = true;
+                                        return -1;
+                                }
+                                f->amo_wait = false;
+                                r = v;
+                                break;
+                        }
+                        r = load(f, t->addr, FUNCT3_LW);
+                        if ((i.funct7 >> 2) == FUNCT5_LR) {
+                                f->resv = t->addr;
+                                f->reserved = true;
+                        } else if ((i.funct7 >> 2) == FUNCT5_SC) {
+                                bool ok = f->reserved && f->resv == t->addr;
+                                if (ok)
+                                        store(f, t->addr, FUNCT3_SW, b);
+                                f->reserved = false;
+                                r = !ok;
+                        } else {
+                                store(f, t->addr, FUNCT3_SW, amo_exec(i.funct7 >> 2, r, b));
+                        }
+                        break;
+                case OP_JAL:
+                case OP_JALR:
+                case OP_BRANCH:
+                        f10 = (i.funct7 << 3) | i.funct3;
+                        r = bru_exec(f10, i.opcode, f->pc, a, b);
+                        t->npc = bru_next_pc(f10, i.opcode, f->pc, a, b, i.immediate);
+                        break;
+                default:
+                        r = alu_exec((i.funct7 << 3) | i.funct3, a, b);
+                        break;
+        }
+
+        if (i.rd != 0 && i.opcode != OP_BRANCH && i.opcode != OP_STORE)
+                f->x[i.rd] = r;
+
+        f->pc = t->npc;
+        f->instret++;
+
+        return 1;
+}
+
+
+static void push(struct func *f, const struct trace_inst *t) {
+        while (!ring_push(f->ring, t) && !atomic_load_explicit(&f->stop, memory_order_relaxed))
+                sched_yield();
+}
+
+
+// Next record, executed or replayed, returns 0 after the last one
+static int next(struct func *f, struct trace_inst *t) {
+        int r;
+
+        if (f->in) {
+                if ((r = trace_read(f->in, t)) < 0)
+                        f->error = EINVAL;
+                return r > 0 ? 1 : -1;
+        }
+
+        r = func_step(f, t);
+        if (f->out && !f->error)
+                f->error = trace_write(f->out, t);
+
+        return r;
+}
+
+
+static void *run(void *arg) {
+        struct func *f = arg;
+        struct trace_inst t = {0};
+        uint32_t pc = 0;
+        int r = 1;
+
+        // The instruction that ends the program is part of the trace
+        while (r > 0 && !atomic_load_explicit(&f->stop, memory_order_relaxed)) {
+                if ((r = next(f, &t)) < 0)
+                        break;
+                push(f, &t);
+                pc = t.pc;
+        }
+
+        if (f->out && !f->error)
+                f->error = trace_close(f->out);
+        if (f->error)
+                fprintf(stderr, "Trace %s: %s\n", f->in ? "replay" : "record", strerror(f->error));
+        atomic_store_explicit(&f->done, true, memory_order_release);
+
+        // End of the trace, twice so that the consumer can always look one
+        // record ahead
+        t = (struct trace_inst) {.pc = pc + 4, .npc = pc + 8};
+        push(f, &t);
+        push(f, &t);
+
+        return NULL;
+}
+
+
+int func_start(struct func *f, struct ring *r) {
+        f->ring = r;
+        atomic_store(&f->stop, false);
+        atomic_store(&f->done, false);
+
+        if (pthread_create(&f->thread, NULL, run, f))
+                return EAGAIN;
+
+        f->running = true;
+
+        return 0;
+}
+
+
+void func_stop(struct func *f) {
+        if (!f->running)
+                return;
+
+        atomic_store(&f->stop, true);
+        pthread_join(f->thread, NULL);
+        f->running = false;
+}
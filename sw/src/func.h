@@ -0,0 +1,73 @@
+/* FUNCTIONAL FRONTEND
+ * Instruction set simulator that runs ahead of the timing model in its own
+ * thread. It executes the program on a private copy of the memory and
+ * pushes every retired instruction with its effective address and the
+ * address of the next instruction into a ring. The engine fetches from the
+ * ring and takes the addresses and branch outcomes from the records, it
+ * never guesses them.
+ *
+ * The records carry no values, the backend still computes the result and
+ * the memory access of every op so that its registers, memory and CSR
+ * counters stay those of the integrated frontend. That work is lost in the
+ * noise of the host time, what the thread takes out of the timing loop is
+ * the fetch and the resolution of addresses and branches.
+ *
+ * The thread can also save the records to a trace file while it runs, or
+ * replay such a file without executing anything. A replay loads no
+ * program, the values the backend computes are then meaningless and only
+ * its timing counts.
+ */
+#ifndef __FUNC_H__
+#define __FUNC_H__
+
+#include "common.h"
+#include "ring.h"
+#include "trace.h"
+#include <pthread.h>
+
+struct func {
+        uint8_t *mem;           // Private copy of the program, NULL runs on the engine memory
+        uint32_t mem_size;
+        uint32_t pc;
+        int32_t x[32];
+        bool halt;
+        uint32_t resv;          // Word reserved by LR
+        uint64_t instret;
+        bool reserved;
+        bool amo_wait;          // Atomic started on the engine memory, not performed yet
+
+        struct trace_file *out; // Trace recorded by the thread
+        struct trace_file *in;  // Trace replayed instead of executing the program
+        int error;              // Status of the trace once the thread is done
+
+        struct ring *ring;
+        pthread_t thread;
+        bool running;
+        _Atomic bool stop;      // Set by the consumer to end the thread early
+        _Atomic bool done;      // Set once the thread is done with the trace file
+};
+
+// Copies the program from mem, mem_size is the size of the engine memory
+int func_create(struct func *f, int mem_size);
+
+// Replays the trace fn, there is no program to execute
+int func_replay(struct func *f, const char *fn);
+
+// Saves the records to the trace fn
+int func_record(struct func *f, const char *fn);
+
+void func_destroy(struct func *f);
+
+/* \fn func_step
+ * \brief Executes one instruction and describes it in t
+ * \return 0 once the instruction ends the program, -1 while an atomic on
+ *         the engine memory waits for the end of the quantum
+ */
+int func_step(struct func *f, struct trace_inst *t);
+
+// Runs the program in a new thread, the trace ends with two null records
+int func_start(struct func *f, struct ring *r);
+
+void func_stop(struct func *f);
+
+#endif
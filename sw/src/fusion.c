@@ -0,0 +1,132 @@
+#include "fusion.h"
+
+const char *fusion_names[NB_FUSIONS] = {
+        [FUSION_LUI_ADDI]   = "lui+addi",
+        [FUSION_AUIPC_ADDI] = "auipc+addi",
+        [FUSION_AUIPC_JALR] = "auipc+jalr",
+        [FUSION_ZEXT]       = "slli+srli",
+        [FUSION_LOAD_PAIR]  = "lw+lw",
+        [FUSION_CMP_BRANCH] = "cmp+branch",
+};
+
+
+static bool is_addi(const struct inst_field *i) {
+        return i->opcode == OP_IMM && i->funct3 == FUNCT3_ADDSUB;
+}
+
+
+// Shift amount of a slli/srli, -1 for any other instruction
+static int shamt(const struct inst_field *i, uint8_t f3) {
+        if (i->opcode != OP_IMM || i->funct3 != f3 || (i->immediate & 0x400))
+                return -1;
+
+        return i->immediate & 0x1F;
+}
+
+
+// The second instruction consumes and overwrites the result of the first
+static bool chained(const struct inst_field *a, const struct inst_field *b) {
+        return a->rd != 0 && b->rs1 == a->rd && b->rd == a->rd;
+}
+
+
+// slt[i][u] rd, a, b ; beqz/bnez rd becomes a bge/blt on a, b that also
+// writes rd, the value of rd is the condition of the blt
+static int cmp_branch(const struct inst_field *a, const struct inst_field *b, struct fused_op *f) {
+        if (a->funct3 != FUNCT3_SLT && a->funct3 != FUNCT3_SLTU)
+                return -1;
+
+        if (a->opcode == OP_OP && a->funct7 != 0)
+                return -1;
+
+        if (a->rd == 0 || b->opcode != OP_BRANCH || (b->funct3 != FUNCT3_BEQ && b->funct3 != FUNCT3_BNE))
+                return -1;
+
+        if (!(b->rs1 == a->rd && b->rs2 == 0) && !(b->rs1 == 0 && b->rs2 == a->rd))
+                return -1;
+
+        f->inst = *b;
+        f->inst.rd = a->rd;
+        f->inst.rs1 = a->rs1;
+        f->inst.rs2 = a->rs2;
+        f->inst.funct3 = (a->funct3 == FUNCT3_SLT ? FUNCT3_BLT : FUNCT3_BLTU) | (b->funct3 == FUNCT3_BEQ);
+
+        f->imm = a->opcode == OP_IMM;
+        f->operand = a->immediate;
+
+        return FUSION_CMP_BRANCH;
+}
+
+
+static int match(const struct inst_field *a, const struct inst_field *b, struct fused_op *f) {
+
+        f->inst = *a;
+        f->imm = false;
+
+        switch (a->opcode) {
+                case OP_LUI:
+                        if (!is_addi(b) || !chained(a, b))
+                                return -1;
+
+                        f->inst.immediate = a->immediate + b->immediate;
+                        return FUSION_LUI_ADDI;
+
+                // Dispatched at the address of the addi/jalr, pc + 4 is
+                // removed from the offset
+                case OP_AUIPC:
+                        if (!chained(a, b))
+                                return -1;
+
+                        f->inst.immediate = a->immediate + b->immediate - 4;
+
+                        if (is_addi(b))
+                                return FUSION_AUIPC_ADDI;
+
+                        if (b->opcode == OP_JALR) {
+                                f->inst.opcode = OP_JAL;
+                                return FUSION_AUIPC_JALR;
+                        }
+
+                        return -1;
+
+                case OP_IMM:
+                        if (b->opcode == OP_BRANCH)
+                                return cmp_branch(a, b, f);
+
+                        // Zero extension
+                        int n = shamt(a, FUNCT3_SL);
+                        if (n < 0 || shamt(b, FUNCT3_SR) != n || !chained(a, b))
+                                return -1;
+
+                        f->inst.funct3 = FUNCT3_AND;
+                        f->inst.immediate = 0xFFFFFFFF >> n;
+                        return FUSION_ZEXT;
+
+                case OP_OP:
+                        return cmp_branch(a, b, f);
+
+                // Same base, adjacent words, the first load does not
+                // overwrite the base
+                case OP_LOAD:
+                        if (b->opcode != OP_LOAD || a->funct3 != FUNCT3_LW || b->funct3 != FUNCT3_LW)
+                                return -1;
+
+                        if (b->rs1 != a->rs1 || a->rd == a->rs1 || b->immediate != a->immediate + 4)
+                                return -1;
+
+                        return FUSION_LOAD_PAIR;
+
+                default:
+                        return -1;
+        }
+}
+
+
+int fusion_match(const struct inst_field *a, const struct inst_field *b, uint32_t whitelist, struct fused_op *f) {
+        int p = match(a, b, f);
+
+        if (p < 0 || !(whitelist & (1 << p)))
+                return -1;
+
+        return p;
+}
@@ -0,0 +1,42 @@
+/* FUSION
+ * Macro-op fusion of two consecutive instructions. A fused pair takes a
+ * single EXB and ROB entry, it is dispatched as if it was the second
+ * instruction of the pair so its fall through and link address stay pc + 4.
+ */
+#ifndef __FUSION_H__
+#define __FUSION_H__
+
+#include "common.h"
+#include "decoder.h"
+
+enum fusion_pattern {
+        FUSION_LUI_ADDI,        // lui rd, hi ; addi rd, rd, lo -> rd = hi + lo
+        FUSION_AUIPC_ADDI,      // auipc rd, hi ; addi rd, rd, lo -> rd = pc + hi + lo
+        FUSION_AUIPC_JALR,      // auipc rd, hi ; jalr rd, lo(rd) -> direct call
+        FUSION_ZEXT,            // slli rd, rs, n ; srli rd, rd, n -> rd = rs & (~0 >> n)
+        FUSION_LOAD_PAIR,       // lw rd1, o(rs) ; lw rd2, o+4(rs) -> one address, one access
+        FUSION_CMP_BRANCH,      // slt[i][u] rd, a, b ; beqz/bnez rd -> bge/blt a, b writing rd
+        NB_FUSIONS
+};
+
+#define FUSION_ALL ((1 << NB_FUSIONS) - 1)
+
+struct fused_op {
+        struct inst_field inst; // Instruction dispatched in place of the pair
+        int32_t operand;        // Second operand of a compare & branch on slti/sltiu
+        bool imm;               // The second operand is the immediate
+};
+
+/* \fn fusion_match
+ * \param a First instruction of the pair
+ * \param b Second instruction of the pair
+ * \param whitelist Bit mask of the enabled patterns
+ * \param f Op to dispatch in place of the pair. For a load pair it is the
+ *          first load, the second one keeps its own ROB entry
+ * \return Pattern fused or -1 if the pair can't be fused
+ */
+int fusion_match(const struct inst_field *a, const struct inst_field *b, uint32_t whitelist, struct fused_op *f);
+
+extern const char *fusion_names[NB_FUSIONS];
+
+#endif
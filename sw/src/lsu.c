@@ -1,6 +1,9 @@
 #include "lsu.h"
 #include "mem.h"
+#include "rob.h"
 #include "RV32I.h"
+#include "mdp.h"
+#include "cache.h"
 
 /* Tasks:
  * -> Buffer Store and loads
@@ -123,7 +126,7 @@
  */
 
 
-static struct lsu_t{
+static CORE_LOCAL struct lsu_t{
 
         int lb_size;
         int lb_nb;
@@ -131,7 +134,22 @@ static struct lsu_t{
                 struct lsu_buf addr;
                 uint32_t data;
                 uint8_t f3; // Type of load operation
+                tag_t qr;   // Tag of the destination
+                tag_t rob;  // Rob entry of the load
+                uint32_t seq; // Store sequence number at dispatch, older stores have a lower one
+                uint32_t pc;
+                uint32_t dep; // Store predicted to write the data
+                uint32_t fwd; // Store that forwarded the data
+                int cycle_left;
                 bool busy;  // Entry is valid in the load buffer
+                bool has_dep;
+                bool has_fwd;
+                bool spec;  // Executed before the address of an older store was known
+                bool waited;
+                bool amo;   // Atomic, the data comes from the memory side
+                bool performed;
+                uint8_t op; // funct5 of the atomic
+                int sb;     // Store entry of the atomic
                 enum lsu_status status;
         } *lb;
 
@@ -139,29 +157,308 @@ static struct lsu_t{
         int sb_nb;
         int sb_read_ptr;
         int sb_write_ptr;
+        uint32_t sb_seq;
         struct store_buf {
                 struct lsu_buf addr, data;
                 uint8_t f3;
+                tag_t rob;
+                uint32_t seq;
+                uint32_t pc;
+                int lb;     // Load entry of an atomic, -1 for a store
+                bool aq;    // Atomic younger loads can't pass
                 bool busy;
                 enum lsu_status status;
         } *sb;
 
+        // Post commit write combining buffer, a fifo of lines drained in
+        // order to the L1D. Empty when wcb_size is 0, stores are then
+        // written at commit
+        int wcb_size;
+        int wcb_nb;
+        int wcb_head;
+        int wcb_drain;          // Entries written to the L1D per cycle
+        int line_size;
+        struct wcb {
+                uint32_t line;  // Address of the first byte of the line
+                uint32_t pc;    // Last store merged in the entry
+                int bytes;      // Bytes written
+                int idle;       // Cycles since the last store merged
+                uint8_t *data;
+                uint8_t *mask;  // Bytes written
+        } *wcb;
+        uint8_t *wcb_bytes;
+
+        int amo_latency;        // Cycles of an atomic at the memory side
+
+        enum mdp_policy policy;
+        struct lsu_stats stats;
+
 } lsu = {0};
 
 
+static int access_size(uint8_t f3) {
+        switch(f3 & 0x3) {
+                case FUNCT3_LB: return 1;
+                case FUNCT3_LH: return 2;
+                default:        return 4;
+        }
+}
+
+
+static bool overlap(uint32_t a, int na, uint32_t b, int nb) {
+        return a < b + nb && b < a + na;
+}
+
+
+// Sign or zero extends the raw value of a load
+static uint32_t extend(uint32_t v, uint8_t f3) {
+        switch(f3) {
+                case FUNCT3_LB:  return (int32_t)(int8_t)v;
+                case FUNCT3_LBU: return (uint8_t)v;
+                case FUNCT3_LH:  return (int32_t)(int16_t)v;
+                case FUNCT3_LHU: return (uint16_t)v;
+                default:         return v;
+        }
+}
+
+
+// WRITE COMBINING BUFFER
+#define WCB_IDLE        8
+static struct wcb *wcb_find(uint32_t line) {
+        for(int i = 0; i < lsu.wcb_nb; i++) {
+                struct wcb *w = &lsu.wcb[(lsu.wcb_head + i) % lsu.wcb_size];
+
+                if(w->line == line)
+                        return w;
+        }
+
+        return NULL;
+}
+
+
+// Reads memory with the committed stores still in the buffer on top,
+// returns the number of bytes that came from the buffer
+static int wcb_read(uint32_t a, int n, uint32_t *v) {
+        int k = 0;
+
+        mem_read(a, v, n);
+
+        for(int i = 0; i < n && lsu.wcb_nb; i++) {
+                uint32_t b = a + i;
+                struct wcb *w = wcb_find(b & -lsu.line_size);
+
+                if(w && w->mask[b - w->line]) {
+                        *v = (*v & ~(0xFFu << (8 * i))) | ((uint32_t)w->data[b - w->line] << (8 * i));
+                        k++;
+                }
+        }
+
+        return k;
+}
+
+
+// Merges a committed store in the entry of its line or in a new one,
+// returns 0 if the buffer has no room for it
+static int wcb_write(uint32_t a, int n, uint32_t v, uint32_t pc) {
+        uint32_t first = a & -lsu.line_size;
+        uint32_t last = (a + n - 1) & -lsu.line_size;
+        int needed = !wcb_find(first) + (last != first && !wcb_find(last));
+
+        if(lsu.wcb_nb + needed > lsu.wcb_size)
+                return 0;
+
+        if(!needed)
+                lsu.stats.wcb_coalesced++;
+
+        for(int i = 0; i < n; i++) {
+                uint32_t b = a + i;
+                struct wcb *w = wcb_find(b & -lsu.line_size);
+
+                if(!w) {
+                        w = &lsu.wcb[(lsu.wcb_head + lsu.wcb_nb++) % lsu.wcb_size];
+                        w->line = b & -lsu.line_size;
+                        w->bytes = 0;
+                        memset(w->mask, 0, lsu.line_size);
+                }
+
+                w->bytes += !w->mask[b - w->line];
+                w->data[b - w->line] = v >> (8 * i);
+                w->mask[b - w->line] = 1;
+                w->pc = pc;
+                w->idle = 0;
+        }
+
+        lsu.stats.wcb_stores++;
+
+        return 1;
+}
+
+
+// Writes the oldest entries to the L1D. The oldest entry stays open for
+// more stores until its line is full, a younger line is waiting or no
+// store merged for WCB_IDLE cycles. An entry whose line can't be
+// allocated blocks the ones behind it
+static void wcb_drain(void) {
+        for(int i = 0; i < lsu.wcb_nb; i++)
+                lsu.wcb[(lsu.wcb_head + i) % lsu.wcb_size].idle++;
+
+        for(int i = 0; i < lsu.wcb_drain && lsu.wcb_nb; i++) {
+                struct wcb *w = &lsu.wcb[lsu.wcb_head];
+
+                if(w->bytes < lsu.line_size && lsu.wcb_nb == 1 && w->idle < WCB_IDLE)
+                        return;
+
+                if(!cache_store(w->line, w->pc)) {
+                        lsu.stats.wcb_drain_stalls++;
+                        return;
+                }
+
+                for(int j = 0; j < lsu.line_size; j++)
+                        if(w->mask[j])
+                                mem_write(w->line + j, &w->data[j], 1);
+
+                lsu.wcb_head = (lsu.wcb_head + 1) % lsu.wcb_size;
+                lsu.wcb_nb--;
+                lsu.stats.wcb_drained++;
+        }
+}
+
+
 // Load
 // 1. Place in buffer
 // 2. If addr in store_buf, foward value to load buf
 // 3. else Depending on where the data is in memory (L? cache, Dram) wait a number of cycles until
+static int load(struct load_buf *l) {
+        uint32_t a = l->addr.value;
+        int n = access_size(l->f3);
+        struct store_buf *fwd = NULL;
+        bool spec = false;
+
+        // The youngest older store that overlaps provides the data. Older
+        // stores without an address are waited for or bypassed depending
+        // on the policy
+        for(int j = 0; j < lsu.sb_size; j++) {
+                struct store_buf *s = &lsu.sb[j];
+
+                if(!s->busy || s->seq >= l->seq)
+                        continue;
+
+                if(!s->addr.r) {
+                        if(lsu.policy == MDP_CONSERVATIVE)
+                                return 0;
+
+                        if(l->has_dep && s->seq == l->dep) {
+                                if(!l->waited)
+                                        lsu.stats.waits++;
+                                l->waited = true;
+                                return 0;
+                        }
+
+                        spec = true;
+                        continue;
+                }
 
-static int load() {
+                // Atomics don't forward, their data comes from the memory
+                if(s->lb >= 0) {
+                        if(s->status != DONE && (s->aq || overlap(a, n, s->addr.value, 4)))
+                                return 0;
+                        continue;
+                }
 
-        return 0;
+                if(overlap(a, n, s->addr.value, access_size(s->f3)) && (!fwd || s->seq > fwd->seq))
+                        fwd = s;
+        }
+
+        if(fwd) {
+                int m = access_size(fwd->f3);
+
+                // Partial overlap or data not there yet, wait for the store
+                if(!fwd->data.r || a < fwd->addr.value || a + n > fwd->addr.value + m)
+                        return 0;
+
+                l->data = extend(fwd->data.value >> (8 * (a - fwd->addr.value)), l->f3);
+                l->cycle_left = 1;
+                l->fwd = fwd->seq;
+                l->has_fwd = true;
+        } else {
+                uint32_t v = 0;
+                int k = wcb_read(a, n, &v);
+
+                // Every byte comes from the write combining buffer
+                if(k == n)
+                        l->cycle_left = 1;
+                // Every MSHR is busy, try again next cycle
+                else if((l->cycle_left = cache_load(a, l->pc)) < 0)
+                        return 0;
+
+                if(k)
+                        lsu.stats.wcb_forwards++;
+
+                l->data = extend(v, l->f3);
+        }
+
+        l->status = REQ;
+        l->spec = spec;
+        if(spec)
+                lsu.stats.speculated++;
+
+        return 1;
+}
+
+
+// An older store does not know its address yet
+static bool unresolved(uint32_t seq) {
+        for(int j = 0; j < lsu.sb_size; j++)
+                if(lsu.sb[j].busy && lsu.sb[j].seq < seq && !lsu.sb[j].addr.r)
+                        return true;
+
+        return false;
+}
+
+
+// Atomic
+// The atomic is performed at the memory once it is the oldest instruction
+// and every older store left the write combining buffer, the L1D drops its
+// copy of the line. In a cluster the result only comes back at the end of
+// the quantum
+static void amo(struct load_buf *l) {
+        struct store_buf *s = &lsu.sb[l->sb];
+        uint32_t v;
+        tag_t head;
+
+        if(l->status == READY) {
+                if(!s->data.r || lsu.wcb_nb || !rob_head(&head) || head != l->rob)
+                        return;
+
+                cache_atomic(l->addr.value);
+                l->performed = mem_amo(l->op, l->addr.value, s->data.value, &v);
+                l->data = v;
+                l->cycle_left = lsu.amo_latency;
+                l->status = REQ;
+                lsu.stats.atomics++;
+        }
+
+        if(l->status != REQ)
+                return;
+
+        if(!l->performed && (l->performed = mem_amo_done(&v)))
+                l->data = v;
+
+        lsu.stats.atomic_cycles++;
+        if(--l->cycle_left > 0 || !l->performed)
+                return;
+
+        l->status = DONE;
+        if(l->op == FUNCT5_SC && l->data)
+                lsu.stats.sc_failures++;
 }
 
+
 // Store
-static int store() {
-        return 0;
+static int store(struct store_buf *s) {
+        uint32_t v = s->data.value;
+
+        return mem_write(s->addr.value, &v, access_size(s->f3));
 }
 
 
@@ -174,26 +471,58 @@ void lsu_destroy(void) {
         if (lsu.sb)
                 free(lsu.sb);
 
+        if (lsu.wcb)
+                free(lsu.wcb);
+
+        if (lsu.wcb_bytes)
+                free(lsu.wcb_bytes);
+
         lsu = (struct lsu_t) {0};
 }
 
 
-int lsu_create(int load_size, int store_size) {
+int lsu_create(int load_size, int store_size, enum mdp_policy policy, int wcb_size, int wcb_drain, int line_size,
+        int amo_latency) {
         // create load buffer
-        lsu.lb = malloc(sizeof(*lsu.lb) * load_size);
+        lsu.lb = calloc(load_size, sizeof(*lsu.lb));
         lsu.lb_size = load_size;
         lsu.lb_nb = 0;
 
         // create store buffer
-        lsu.sb = malloc(sizeof(*lsu.sb) * store_size);
-        lsu.sb_size = load_size;
+        lsu.sb = calloc(store_size, sizeof(*lsu.sb));
+        lsu.sb_size = store_size;
         lsu.sb_nb = 0;
         lsu.sb_write_ptr = 0;
         lsu.sb_read_ptr = 0;
+        lsu.sb_seq = 0;
+
+        lsu.amo_latency = amo_latency;
+        lsu.policy = policy;
+        lsu.stats = (struct lsu_stats) {0};
 
         if(!lsu.lb || !lsu.sb)
                 goto CLEANUP;
 
+        // Write combining buffer, one line of data and mask per entry
+        lsu.wcb_size = wcb_size;
+        lsu.wcb_nb = 0;
+        lsu.wcb_head = 0;
+        lsu.wcb_drain = wcb_drain;
+        lsu.line_size = line_size;
+
+        if(wcb_size) {
+                lsu.wcb = calloc(wcb_size, sizeof(*lsu.wcb));
+                lsu.wcb_bytes = calloc(2 * wcb_size, line_size);
+
+                if(!lsu.wcb || !lsu.wcb_bytes)
+                        goto CLEANUP;
+
+                for(int i = 0; i < wcb_size; i++) {
+                        lsu.wcb[i].data = &lsu.wcb_bytes[2 * i * line_size];
+                        lsu.wcb[i].mask = &lsu.wcb_bytes[(2 * i + 1) * line_size];
+                }
+        }
+
         // Checks
         return 0;
 
@@ -203,46 +532,165 @@ CLEANUP:
 }
 
 
-int lsu_sched_load(struct lsu_buf addr, uint8_t f3) {
+int lsu_full_load(void) {
+        return lsu.lb_nb == lsu.lb_size;
+}
+
+
+int lsu_free_load(void) {
+        return lsu.lb_size - lsu.lb_nb;
+}
+
+
+int lsu_full_store(void) {
+        return lsu.sb_nb == lsu.sb_size;
+}
+
+
+// Allocates a load, the address comes later from the AGU
+// Returns the index of the entry or -1 if the buffer is full
+int lsu_sched_load(uint8_t f3, tag_t qr, tag_t rob, uint32_t pc) {
         if (lsu.lb_size == lsu.lb_nb)
-                return 0;
+                return -1;
 
         for(int i = 0; i < lsu.lb_size; i++) {
                 if(!lsu.lb[i].busy) {
-                        lsu.lb[i].addr = addr;
-                        lsu.lb[i].busy = true;
-                        lsu.lb[i].f3 = f3;
-                        lsu.lb[i].status = addr.r ? WAIT : READY;
+                        lsu.lb[i] = (struct load_buf) {
+                                .addr = { .r = false },
+                                .f3 = f3,
+                                .qr = qr,
+                                .rob = rob,
+                                .seq = lsu.sb_seq,
+                                .pc = pc,
+                                .busy = true,
+                                .status = WAIT,
+                        };
+
+                        if(lsu.policy == MDP_STORE_SETS)
+                                lsu.lb[i].has_dep = mdp_load(pc, &lsu.lb[i].dep);
 
                         lsu.lb_nb++;
-                        goto SHEDULED;
+                        return i;
                 }
         }
 
-        // TODO: ERROR if we arrive here
-        return 0;
-SHEDULED:
-        return 1;
+        return -1;
 }
 
-int lsu_sched_store(struct lsu_buf addr, struct lsu_buf data, uint8_t f3) {
+
+// Allocates a store in program order, the data may still be on its way
+// Returns the index of the entry or -1 if the buffer is full
+int lsu_sched_store(struct lsu_buf data, uint8_t f3, tag_t rob, uint32_t pc) {
         if (lsu.sb_size == lsu.sb_nb)
-                return 0;
+                return -1;
+
+        int i = lsu.sb_write_ptr;
 
-        lsu.sb[lsu.sb_write_ptr++] = (struct store_buf) {
-                .addr = addr,
+        lsu.sb[i] = (struct store_buf) {
+                .addr = { .r = false },
                 .data = data,
                 .busy = true,
                 .f3 = f3,
-                .status = (addr.r | data.r) ? WAIT : READY,
+                .rob = rob,
+                .seq = lsu.sb_seq++,
+                .pc = pc,
+                .lb = -1,
+                .status = WAIT,
         };
 
+        if(lsu.policy == MDP_STORE_SETS)
+                mdp_store(pc, lsu.sb[i].seq);
+
         lsu.sb_nb++;
-        lsu.sb_write_ptr %= lsu.sb_size;
+        lsu.sb_write_ptr = (lsu.sb_write_ptr + 1) % lsu.sb_size;
+
+        return i;
+}
+
+
+// Allocates an atomic in the store buffer, to keep it in order with the
+// stores, and in the load buffer, to write back its result
+// Returns the index of the store entry, the AGU sets the address of both
+int lsu_sched_amo(struct lsu_buf data, uint8_t funct7, tag_t qr, tag_t rob, uint32_t pc) {
+        if (lsu.lb_size == lsu.lb_nb || lsu.sb_size == lsu.sb_nb)
+                return -1;
+
+        int s = lsu_sched_store(data, FUNCT3_AMO_W, rob, pc);
+        int l = lsu_sched_load(FUNCT3_LW, qr, rob, pc);
+
+        lsu.lb[l].seq = lsu.sb[s].seq;
+        lsu.lb[l].has_dep = false;
+        lsu.lb[l].amo = true;
+        lsu.lb[l].op = funct7 >> 2;
+        lsu.lb[l].sb = s;
+
+        lsu.sb[s].lb = l;
+        lsu.sb[s].aq = funct7 & 0x2;
+
+        return s;
+}
+
+
+// Address computed by the AGU
+void lsu_set_load_addr(int idx, uint32_t addr) {
+        lsu.lb[idx].addr = (struct lsu_buf) { .value = addr, .r = true };
+        lsu.lb[idx].status = READY;
+}
+
+
+// Younger loads that already read the address without getting the data
+// of this store, or of a younger one, violated the memory ordering. Every
+// violation trains the predictor, the oldest load is returned to be replayed
+int lsu_set_store_addr(int idx, uint32_t addr, tag_t *rob, uint32_t *pc) {
+        struct store_buf *s = &lsu.sb[idx];
+        struct load_buf *v = NULL;
+
+        s->addr = (struct lsu_buf) { .value = addr, .r = true };
+
+        if(s->lb >= 0)
+                lsu_set_load_addr(s->lb, addr);
+
+        for(int i = 0; i < lsu.lb_size; i++) {
+                struct load_buf *l = &lsu.lb[i];
+
+                if(!l->busy || !l->spec || l->status == WAIT || l->status == READY || l->seq <= s->seq)
+                        continue;
+
+                if(!overlap(l->addr.value, access_size(l->f3), addr, access_size(s->f3)))
+                        continue;
+
+                if(l->has_fwd && l->fwd > s->seq)
+                        continue;
+
+                if(lsu.policy == MDP_STORE_SETS)
+                        mdp_violation(l->pc, s->pc);
+
+                if(!v || rob_age(l->rob) < rob_age(v->rob))
+                        v = l;
+        }
+
+        if(!v)
+                return 0;
+
+        lsu.stats.violations++;
+        *rob = v->rob;
+        *pc = v->pc;
 
         return 1;
 }
 
+
+// Snoop a CDB lane for the data of the stores
+void lsu_cdb(tag_t q, int32_t value) {
+        for(int i = 0; i < lsu.sb_size; i++) {
+                if(lsu.sb[i].busy && !lsu.sb[i].data.r && lsu.sb[i].data.q == q) {
+                        lsu.sb[i].data.value = value;
+                        lsu.sb[i].data.r = true;
+                }
+        }
+}
+
+
 int lsu_exec(void) {
 
         //RVWMO =
@@ -251,60 +699,166 @@ int lsu_exec(void) {
         // Thread can read own it's writes early (store fowarding to load)
 
         // Load buffer
-        // Load must be sent ASAP
+        // Load must be sent ASAP, the oldest first when they compete for
+        // the MSHRs
+        int ready[lsu.lb_size];
+        int nb_ready = 0;
+
         for(int i = 0; i < lsu.lb_size; i++) {
-                if(lsu.lb[i].busy && lsu.lb[i].status == READY) {
-                        //TODO: Here it should be "REQ", but skipping cuz need
-                        //      infrastructure to model memory hierarchy
-
-                        // Is value in STORE buf?
-                        for(int j = 0; j < lsu.sb[i].
-
-                        // Go fetch in memory
-                        int n = 1;
-                        switch(lsu.lb[i].f3) {
-                                case FUNCT3_LB:
-                                case FUNCT3_LBU:
-                                        n=1;
-                                        break;
-                                case FUNCT3_LHU:
-                                case FUNCT3_LH:
-                                        n=2;
-                                        break;
-                                case FUNCT3_LW:
-                                        n=4;
-                                        break;
-                        };
-                        mem_read(lsu.lb[i].addr.value, &lsu.lb[i].data, n);
-                        lsu.lb[i].status = DONE;
+                struct load_buf *l = &lsu.lb[i];
+
+                if(!l->busy)
+                        continue;
+
+                if(l->amo)
+                        amo(l);
+                else if(l->status == REQ && --l->cycle_left <= 0)
+                        l->status = DONE;
+                else if(l->status == CHECK && !unresolved(l->seq)) {
+                        l->busy = false;
+                        lsu.lb_nb--;
+                }
+                else if(l->status == READY) {
+                        int j = nb_ready++;
+
+                        for(; j > 0 && rob_age(lsu.lb[ready[j - 1]].rob) > rob_age(l->rob); j--)
+                                ready[j] = ready[j - 1];
+                        ready[j] = i;
                 }
         }
 
+        for(int i = 0; i < nb_ready; i++)
+                load(&lsu.lb[ready[i]]);
+
+        wcb_drain();
+
         // Store buffer
         // NOTE: Store must be send in program order, the sb must therefore be a fifo
+        //       they are only written to memory once committed
+        for(int i = 0; i < lsu.sb_size; i++) {
+                struct store_buf *s = &lsu.sb[i];
+
+                if(s->busy && s->lb < 0 && s->status == WAIT && s->addr.r && s->data.r)
+                        s->status = READY;
+        }
+
+        return 0;
+}
+
+
+// Returns a store that got its address and data, it can be committed
+int lsu_store_ready(tag_t *rob) {
         for(int i = 0; i < lsu.sb_size; i++) {
                 if(lsu.sb[i].busy && lsu.sb[i].status == READY) {
-                        int n = 1;
-                        switch(lsu.lb[i].f3) {
-                                case FUNCT3_LB:
-                                case FUNCT3_LBU:
-                                        n=1;
-                                        break;
-                                case FUNCT3_LHU:
-                                case FUNCT3_LH:
-                                        n=2;
-                                        break;
-                                case FUNCT3_LW:
-                                        n=4;
-                                        break;
-                        };
+                        lsu.sb[i].status = DONE;
+                        *rob = lsu.sb[i].rob;
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+
+// Writes the oldest store to memory if it belongs to the committed rob entry
+// Returns -1 if it does but the store can't be written yet
+int lsu_commit_store(tag_t rob) {
+        struct store_buf *s = &lsu.sb[lsu.sb_read_ptr];
+
+        if(!lsu.sb_nb || !s->busy || s->status != DONE || s->rob != rob)
+                return 0;
+
+        // Commit waits for room in the write combining buffer, or without
+        // one for an MSHR to allocate the line. An atomic already wrote
+        // the memory
+        if(s->lb < 0 && lsu.wcb_size) {
+                if(!wcb_write(s->addr.value, access_size(s->f3), s->data.value, s->pc))
+                        return -1;
+        } else if(s->lb < 0) {
+                if(!cache_store(s->addr.value, s->pc))
+                        return -1;
+
+                store(s);
+        }
+
+        s->busy = false;
+        lsu.sb_nb--;
+        lsu.sb_read_ptr = (lsu.sb_read_ptr + 1) % lsu.sb_size;
+
+        return 1;
+}
+
+
+// Removes the loads and stores younger than the rob entry after a mispredict
+void lsu_squash(tag_t rob) {
+        int age = rob_age(rob);
+
+        for(int i = 0; i < lsu.lb_size; i++) {
+                if(lsu.lb[i].busy && rob_age(lsu.lb[i].rob) > age) {
+                        lsu.lb[i].busy = false;
+                        lsu.lb_nb--;
+                }
+        }
+
+        // Stores are in program order, drop them from the tail of the fifo
+        while(lsu.sb_nb) {
+                int i = (lsu.sb_write_ptr + lsu.sb_size - 1) % lsu.sb_size;
+
+                if(rob_age(lsu.sb[i].rob) <= age)
+                        break;
+
+                lsu.sb_seq = lsu.sb[i].seq;
+                lsu.sb[i].busy = false;
+                lsu.sb_nb--;
+                lsu.sb_write_ptr = i;
+        }
+}
+
+
+// Returns the first load from idx that has its data, -1 if none
+int lsu_wb_next(int idx, tag_t *rob) {
+        for(int i = idx; i < lsu.lb_size; i++) {
+                struct load_buf *l = &lsu.lb[i];
+
+                if(l->busy && l->status == DONE) {
+                        *rob = l->rob;
+                        return i;
                 }
         }
 
+        return -1;
+}
+
+
+// Writes back a load that has its data, the entry is freed unless the
+// load is speculative and must still be checked against older stores
+void lsu_wb(int idx, tag_t *qr, tag_t *rob, int32_t *data) {
+        struct load_buf *l = &lsu.lb[idx];
+
+        *qr = l->qr;
+        *rob = l->rob;
+        *data = l->data;
+
+        // The atomic commits with its store entry
+        if(l->amo)
+                lsu.sb[l->sb].status = DONE;
+
+        if(l->spec && unresolved(l->seq)) {
+                l->status = CHECK;
+                return;
+        }
+
+        l->busy = false;
+        lsu.lb_nb--;
 }
 
-int lsu_wb(struct cdb_data data) {
 
+// Every committed store reached the L1D
+int lsu_drained(void) {
+        return lsu.wcb_nb == 0;
 }
 
 
+void lsu_get_stats(struct lsu_stats *s) {
+        *s = lsu.stats;
+}
@@ -2,20 +2,76 @@
 #define __LSU_H__
 
 #include "common.h"
+#include "mdp.h"
 
 struct lsu_buf {
         uint32_t value;
-        uint8_t q;
-        bool r;
+        tag_t q;        // Tag to watch for on the CDB
+        bool r;         // Value is ready
 };
 
 
 enum lsu_status {
         WAIT,   // Buffer is waiting on operands
         READY,  // Buffer is ready to send a request
-        //REQ,    // Request has been sent to read/write the data
-        DONE    // Data has been correctly written/read and buffer is done
+        REQ,    // Request has been sent to read/write the data
+        DONE,   // Data has been correctly written/read and buffer is done
+        CHECK   // Speculative load written back, kept until the older stores know their address
 };
 
 
+struct lsu_stats {
+        uint64_t speculated;    // Loads executed before the address of an older store
+        uint64_t violations;    // Stores that found a younger load already executed
+        uint64_t waits;         // Loads held back by the dependence predictor
+        uint64_t wcb_stores;    // Committed stores that entered the write combining buffer
+        uint64_t wcb_coalesced; // Stores merged in entries already in the buffer
+        uint64_t wcb_drained;   // Entries written to the L1D
+        uint64_t wcb_drain_stalls; // Cycles the oldest entry waited for an MSHR
+        uint64_t wcb_forwards;  // Loads that read bytes still in the buffer
+        uint64_t atomics;       // LR, SC and AMOs performed
+        uint64_t atomic_cycles; // Cycles from the start of the atomics to their result
+        uint64_t sc_failures;   // SC that lost their reservation
+};
+
+
+int lsu_create(int load_size, int store_size, enum mdp_policy policy, int wcb_size, int wcb_drain, int line_size,
+        int amo_latency);
+
+void lsu_destroy(void);
+
+int lsu_full_load(void);
+
+int lsu_free_load(void);
+
+int lsu_full_store(void);
+
+int lsu_sched_load(uint8_t f3, tag_t qr, tag_t rob, uint32_t pc);
+
+int lsu_sched_store(struct lsu_buf data, uint8_t f3, tag_t rob, uint32_t pc);
+
+int lsu_sched_amo(struct lsu_buf data, uint8_t funct7, tag_t qr, tag_t rob, uint32_t pc);
+
+void lsu_set_load_addr(int idx, uint32_t addr);
+
+int lsu_set_store_addr(int idx, uint32_t addr, tag_t *rob, uint32_t *pc);
+
+void lsu_cdb(tag_t q, int32_t value);
+
+int lsu_exec(void);
+
+int lsu_store_ready(tag_t *rob);
+
+int lsu_commit_store(tag_t rob);
+
+void lsu_squash(tag_t rob);
+
+int lsu_wb_next(int idx, tag_t *rob);
+
+void lsu_wb(int idx, tag_t *qr, tag_t *rob, int32_t *data);
+
+int lsu_drained(void);
+
+void lsu_get_stats(struct lsu_stats *s);
+
 #endif
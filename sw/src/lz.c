@@ -0,0 +1,130 @@
+#include "lz.h"
+
+#define LZ_MIN_MATCH    4
+#define LZ_HASH_BITS    12
+#define LZ_MAX_OFFSET   0xFFFF
+
+
+static uint32_t read32(const uint8_t *p) {
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint32_t hash(uint32_t v) {
+        return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+
+// Lengths above 15 continue in bytes of 255
+static uint8_t *put_len(uint8_t *o, int len) {
+        for (; len >= 255; len -= 255)
+                *o++ = 255;
+        *o++ = len;
+        return o;
+}
+
+
+static uint8_t *put_seq(uint8_t *o, const uint8_t *lit, int nlit, int off, int mlen) {
+        uint8_t *token = o++;
+
+        *token = (nlit < 15 ? nlit : 15) << 4;
+        if (nlit >= 15)
+                o = put_len(o, nlit - 15);
+        memcpy(o, lit, nlit);
+        o += nlit;
+
+        // The last sequence of a block only has literals
+        if (mlen) {
+                *o++ = off;
+                *o++ = off >> 8;
+                mlen -= LZ_MIN_MATCH;
+                *token |= mlen < 15 ? mlen : 15;
+                if (mlen >= 15)
+                        o = put_len(o, mlen - 15);
+        }
+
+        return o;
+}
+
+
+int lz_compress(const uint8_t *in, int n, uint8_t *out) {
+        int table[1 << LZ_HASH_BITS];
+        uint8_t *o = out;
+        int anchor = 0;
+
+        for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+                table[i] = -1;
+
+        for (int i = 0; i + LZ_MIN_MATCH <= n; ) {
+                uint32_t v = read32(&in[i]);
+                uint32_t h = hash(v);
+                int ref = table[h];
+
+                table[h] = i;
+                if (ref < 0 || i - ref > LZ_MAX_OFFSET || read32(&in[ref]) != v) {
+                        i++;
+                        continue;
+                }
+
+                int len = LZ_MIN_MATCH;
+                while (i + len < n && in[ref + len] == in[i + len])
+                        len++;
+
+                o = put_seq(o, &in[anchor], i - anchor, i - ref, len);
+                i += len;
+                anchor = i;
+        }
+
+        o = put_seq(o, &in[anchor], n - anchor, 0, 0);
+
+        return o - out;
+}
+
+
+static int get_len(const uint8_t **p, const uint8_t *end, int len) {
+        if (len < 15)
+                return len;
+
+        for (uint8_t b = 255; b == 255; len += b) {
+                if (*p == end)
+                        return -1;
+                b = *(*p)++;
+        }
+
+        return len;
+}
+
+
+int lz_decompress(const uint8_t *in, int n, uint8_t *out, int cap) {
+        const uint8_t *p = in, *end = in + n;
+        int o = 0;
+
+        while (p < end) {
+                uint8_t token = *p++;
+                int nlit = get_len(&p, end, token >> 4);
+
+                if (nlit < 0 || nlit > end - p || o + nlit > cap)
+                        return -1;
+                memcpy(&out[o], p, nlit);
+                p += nlit;
+                o += nlit;
+
+                if (p == end)
+                        break;
+
+                if (end - p < 2)
+                        return -1;
+                int off = p[0] | p[1] << 8;
+                p += 2;
+
+                int mlen = get_len(&p, end, token & 0xF);
+                if (mlen < 0 || off == 0 || off > o || o + mlen + LZ_MIN_MATCH > cap)
+                        return -1;
+
+                // Byte by byte, the match may overlap what it copies
+                for (int i = 0; i < mlen + LZ_MIN_MATCH; i++, o++)
+                        out[o] = out[o - off];
+        }
+
+        return o;
+}
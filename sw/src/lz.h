@@ -0,0 +1,21 @@
+/* LZ
+ * Byte oriented LZ77 block compressor in the spirit of LZ4: a greedy
+ * parse with a single hash table probe, sequences of literals followed by
+ * a back reference. Fast rather than tight, it only has to squeeze the
+ * redundancy the trace encoder leaves, mostly the records of loop bodies.
+ */
+#ifndef __LZ_H__
+#define __LZ_H__
+
+#include "common.h"
+
+// Worst case size of n compressed bytes
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Returns the compressed size, out holds at least LZ_BOUND(n) bytes
+int lz_compress(const uint8_t *in, int n, uint8_t *out);
+
+// Returns the decompressed size, -1 if the block is corrupt or too large
+int lz_decompress(const uint8_t *in, int n, uint8_t *out, int cap);
+
+#endif
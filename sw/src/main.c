@@ -7,17 +7,334 @@
 #include "mem.h"
 #include "elf.h"
 #include "engine.h"
+#include "smp.h"
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
 
 struct elf_file ef;
 int retval = 0;
 
+static void usage(const char *name) {
+        fprintf(stderr,
+                "Usage: %s [options] program.txt|program.elf\n"
+                "       %s [options] -F replay:trace\n"
+                "  -m <size>    Memory size in bytes\n"
+                "  -e <size>    Execution buffer size\n"
+                "  -r <size>    ROB size\n"
+                "  -c <lanes>   Number of CDB lanes\n"
+                "  -a <policy>  CDB arbitration: fixed, round-robin, oldest\n"
+                "  -L           CDB look-ahead, an initiator with a second value ready keeps the bus\n"
+                "  -W <width>   Instructions dispatched per cycle\n"
+                "  -u <units>   Number of ALUs\n"
+                "  -U <pool>    Unit pool, type:count:latency:interval with type\n"
+                "               one of alu, mul, div, agu, bru\n"
+                "  -l <size>    Load buffer size\n"
+                "  -t <size>    Store buffer size\n"
+                "  -M <cycles>  Memory latency\n"
+                "  -C <cache>   L1D size:ways:line:latency:mshrs, size 0 has no cache and\n"
+                "               0 MSHRs is unlimited\n"
+                "  -p <pf>      L1D prefetcher type:degree:distance with type one of\n"
+                "               none, next-line, stride, stream\n"
+                "  -B <s:d>     Write combining buffer of s lines drained d per cycle, 0 writes\n"
+                "               stores at commit\n"
+                "  -A <cycles>  Latency of an atomic at the memory side, after the memory latency\n"
+                "  -d <policy>  Loads and older stores without an address: conservative,\n"
+                "               speculate, store-sets\n"
+                "  -S <s:l>     Store set tables, SSIT and LFST entries\n"
+                "  -P <pregs>   Use a physical register file of <pregs> registers\n"
+                "  -s <policy>  Issue select policy: oldest, position, random, critical\n"
+                "  -k <ckpts>   Rename checkpoints, 0 always walks back the ROB\n"
+                "  -R <cycles>  Latency of a checkpoint restore\n"
+                "  -w <width>   ROB entries undone per cycle when walking back\n"
+                "  -f <list>    Fusion whitelist, comma separated patterns or all: lui+addi,\n"
+                "               auipc+addi, auipc+jalr, slli+srli, lw+lw, cmp+branch\n"
+                "  -F <fe>      Frontend integrated, or decoupled[:ring] to follow the trace of a\n"
+                "               functional thread through a ring of <ring> records,\n"
+                "               record:file[:ring] also saves the trace and replay:file[:ring]\n"
+                "               follows a saved trace without a program\n"
+                "  -N <cores>   Cores sharing the memory, each in its own thread, the hart id\n"
+                "               is in a0 and the number of cores in a1. Needs the integrated\n"
+                "               frontend\n"
+                "  -Q <cycles>  Quantum of the cores, stores are seen by the other cores at the\n"
+                "               next quantum, SC and AMOs complete at the end of theirs\n"
+                "  -O <coh>     L1D coherence protocol:c2c:inv with protocol one of none, msi,\n"
+                "               mesi, c2c the latency of a line sent by another core and inv\n"
+                "               the latency of an upgrade, for 2 cores or more\n"
+                "  -i <roi>     Regions of interest between the addi x0, x0, 1 and 2 markers:\n"
+                "               off, stats counts only inside them, fast also fast-forwards the\n"
+                "               program outside them. addi x0, x0, 3 dumps the counters of a\n"
+                "               single core and addi x0, x0, 4 zeroes them\n"
+                "  -H <rows>    Hotspots: cycles, ROB head stalls, EXB waits and mispredict\n"
+                "               penalties charged to the instruction addresses, the report\n"
+                "               shows the <rows> addresses with the most cycles or all of them\n"
+                "  -g <report>  Profile of the functions: gprof for a flat profile and call\n"
+                "               graph, folded:<file> for the stacks of flamegraph.pl\n"
+                "  -y <elf>     Symbols of the functions, by default from the ELF program\n"
+                "  -x           Critical path of the dependence graph, cycles per edge type:\n"
+                "               operands, issue, units, CDB, memory, ROB and EXB capacity\n"
+                "  -V <vcd>     Waveforms of the core for GTKWave, file:first:last writes the\n"
+                "               cycles first to last, signals named after hw/src/core.vhd.\n"
+                "               The EXB busy bits and CDB requests show the first 64 entries\n"
+                "  -n <cycles>  Stop after <cycles> cycles (0 = no limit)\n",
+                name, name);
+}
+
+
+static const char *select_names[] = {
+        [SELECT_OLDEST]   = "oldest",
+        [SELECT_POSITION] = "position",
+        [SELECT_RANDOM]   = "random",
+        [SELECT_CRITICAL] = "critical",
+};
+
+
+static const char *roi_names[] = {
+        [ROI_OFF]   = "off",
+        [ROI_STATS] = "stats",
+        [ROI_FAST]  = "fast",
+};
+
+
+static const char *cdb_names[] = {
+        [CDB_FIXED]       = "fixed",
+        [CDB_ROUND_ROBIN] = "round-robin",
+        [CDB_OLDEST]      = "oldest",
+};
+
+
+static const char *pool_names[] = {
+        [UNIT_ALU] = "alu",
+        [UNIT_MUL] = "mul",
+        [UNIT_DIV] = "div",
+        [UNIT_AGU] = "agu",
+        [UNIT_BRU] = "bru",
+};
+
+
+static const char *frontend_names[] = {
+        [FRONTEND_INTEGRATED] = "integrated",
+        [FRONTEND_DECOUPLED]  = "decoupled",
+        [FRONTEND_RECORD]     = "record",
+        [FRONTEND_REPLAY]     = "replay",
+};
+
+
+static int parse_name(const char *names[], int n, const char *s) {
+        for (int i = 0; i < n; i++)
+                if (!strcmp(names[i], s))
+                        return i;
+
+        return -1;
+}
+
+
+// type:count:latency:interval
+static int parse_pool(struct engine_parameters *ep, char *s) {
+        char *tok = strtok(s, ":");
+        int t;
+
+        if (!tok || (t = parse_name(pool_names, NB_UNIT_TYPES, tok)) < 0)
+                return -1;
+
+        int *field[] = {&ep->pool[t].count, &ep->pool[t].latency, &ep->pool[t].interval};
+        for (int i = 0; i < 3 && (tok = strtok(NULL, ":")); i++)
+                *field[i] = strtol(tok, NULL, 0);
+
+        return 0;
+}
+
+
+// mode[:file][:ring], record and replay need a trace file
+static int parse_frontend(struct engine_parameters *ep, char *s) {
+        char *tok = strtok(s, ":");
+        int f;
+
+        if (!tok || (f = parse_name(frontend_names, 4, tok)) < 0)
+                return -1;
+
+        ep->frontend = f;
+        if (f == FRONTEND_RECORD || f == FRONTEND_REPLAY)
+                if (!(ep->trace = strtok(NULL, ":")))
+                        return -1;
+
+        if ((tok = strtok(NULL, ":")))
+                ep->ring_size = strtol(tok, NULL, 0);
+
+        return 0;
+}
+
+
+// Comma separated list of fusion patterns
+static int parse_fusion(struct engine_parameters *ep, char *s) {
+        int p;
+
+        ep->fusion = 0;
+        for (char *tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+                if (!strcmp(tok, "all"))
+                        ep->fusion = FUSION_ALL;
+                else if ((p = parse_name(fusion_names, NB_FUSIONS, tok)) >= 0)
+                        ep->fusion |= 1 << p;
+                else if (strcmp(tok, "none"))
+                        return -1;
+        }
+
+        return 0;
+}
+
+
+// type:degree:distance
+static int parse_prefetch(struct engine_parameters *ep, char *s) {
+        char *tok = strtok(s, ":");
+        int t;
+
+        if (!tok || (t = parse_name(prefetch_names, NB_PREFETCHERS, tok)) < 0)
+                return -1;
+
+        ep->l1d.prefetch = t;
+        if ((tok = strtok(NULL, ":")))
+                ep->l1d.degree = strtol(tok, NULL, 0);
+        if ((tok = strtok(NULL, ":")))
+                ep->l1d.distance = strtol(tok, NULL, 0);
+
+        return 0;
+}
+
+
+// protocol:c2c:inv
+static int parse_coherence(struct engine_parameters *ep, char *s) {
+        char *tok = strtok(s, ":");
+        int t;
+
+        if (!tok || (t = parse_name(coh_names, NB_COH_PROTOCOLS, tok)) < 0)
+                return -1;
+
+        ep->l1d.coherence = t;
+        if ((tok = strtok(NULL, ":")))
+                ep->l1d.c2c_latency = strtol(tok, NULL, 0);
+        if ((tok = strtok(NULL, ":")))
+                ep->l1d.inv_latency = strtol(tok, NULL, 0);
+
+        return 0;
+}
+
+
+// file[:first[:last]], every cycle by default
+static int parse_vcd(struct engine_parameters *ep, char *s) {
+        char *tok = strtok(s, ":");
+
+        if (!tok)
+                return -1;
+
+        ep->vcd = tok;
+        ep->vcd_first = 0;
+        ep->vcd_last = UINT64_MAX;
+        if ((tok = strtok(NULL, ":")))
+                ep->vcd_first = strtoull(tok, NULL, 0);
+        if ((tok = strtok(NULL, ":")))
+                ep->vcd_last = strtoull(tok, NULL, 0);
+
+        return ep->vcd_first > ep->vcd_last ? -1 : 0;
+}
+
+
+static double elapsed(const struct timespec *start, const struct timespec *end) {
+        return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+
+// Simulated performance of a core
+static void print_stats(const struct engine_parameters *ep, const struct engine_stats *s) {
+        printf("select    : %s\n", select_names[ep->select_policy]);
+        printf("cycles    : %" PRIu64 "\n", s->cycles);
+        printf("instret   : %" PRIu64 "\n", s->instret);
+        printf("ipc       : %.3f\n", s->cycles ? (double)s->instret / s->cycles : 0.0);
+        printf("dispatch  : %" PRIu64 " ops, %" PRIu64 " in-group deps\n", s->dispatched, s->group_deps);
+        printf("full      : %" PRIu64 " rob, %" PRIu64 " exb, %" PRIu64 " lsq, %" PRIu64 " prf cycles\n",
+                s->rob_full, s->exb_full, s->lsq_full, s->prf_full);
+
+        // Top-down, the dispatched ops that never committed were squashed
+        uint64_t squashed = s->dispatched > s->slots_retiring ? s->dispatched - s->slots_retiring : 0;
+        uint64_t slots = (uint64_t)ep->dispatch_width * s->cycles;
+        double pct = slots ? 100.0 / slots : 0.0;
+        printf("topdown   : %d slots/cycle, retiring %.1f%%, bad spec %.1f%%, frontend %.1f%%, backend %.1f%% "
+                "(memory %.1f%%, core %.1f%%)\n", ep->dispatch_width,
+                pct * s->slots_retiring, pct * (squashed + s->slots_empty[SLOT_BAD_SPEC]),
+                pct * s->slots_empty[SLOT_FRONTEND],
+                pct * (s->slots_empty[SLOT_MEMORY] + s->slots_empty[SLOT_CORE]),
+                pct * s->slots_empty[SLOT_MEMORY], pct * s->slots_empty[SLOT_CORE]);
+        printf("writes    : %" PRIu64 "\n", s->value_writes);
+        printf("reads     : %" PRIu64 " reg, %" PRIu64 " cdb, %" PRIu64 " rob\n",
+                s->reads_reg, s->reads_cdb, s->reads_rob);
+        printf("storage   : %" PRIu64 " bits\n", s->storage_bits);
+        for (int t = 0; t < NB_UNIT_TYPES; t++)
+                printf("pool %-4s : %" PRIu64 " issued, %" PRIu64 " stalls, %" PRIu64 " cdb stalls\n",
+                        pool_names[t], s->pool_issued[t], s->pool_stalls[t], s->cdb_stalls[t]);
+        printf("cdb       : %s%s, lanes busy", cdb_names[ep->cdb_policy], ep->cdb_lookahead ? " look-ahead" : "");
+        for (int l = 0; l < ep->cdb_size && l < CDB_MAX_LANES; l++)
+                printf(" %" PRIu64, s->cdb_lane_busy[l]);
+        printf("\n");
+        printf("lsu       : %" PRIu64 " cdb stalls\n", s->cdb_stalls[CDB_LSU]);
+        if (ep->wcb_size)
+                printf("wcb       : %" PRIu64 " stores, %" PRIu64 " coalesced, %" PRIu64 " lines drained (%.2f stores/line), "
+                        "%" PRIu64 " drain stalls, %" PRIu64 " commit stalls, %" PRIu64 " forwards\n",
+                        s->wcb_stores, s->wcb_coalesced, s->wcb_drained,
+                        s->wcb_drained ? (double)s->wcb_stores / s->wcb_drained : 0.0,
+                        s->wcb_drain_stalls, s->store_stalls, s->wcb_forwards);
+        if (s->atomics)
+                printf("atomics   : %" PRIu64 " performed, %.2f cycles each, %" PRIu64 " sc failures\n",
+                        s->atomics, (double)s->atomic_cycles / s->atomics, s->sc_failures);
+        printf("memdep    : %s, %" PRIu64 " speculative loads, %" PRIu64 " waited, %" PRIu64 " violations\n",
+                mdp_names[ep->mdp_policy], s->loads_speculated, s->loads_waited, s->violations);
+        if (ep->l1d.size) {
+                const struct cache_stats *c = &s->l1d;
+                uint64_t used = c->pf_useful + c->pf_late;
+
+                printf("l1d       : %" PRIu64 " loads, %" PRIu64 " stores, %" PRIu64 " misses (%.2f%%)\n",
+                        c->loads, c->stores, c->misses,
+                        c->loads + c->stores ? 100.0 * c->misses / (c->loads + c->stores) : 0.0);
+                printf("mshr      : %" PRIu64 " merged, %" PRIu64 " refused misses, %" PRIu64 " commit stalls\n",
+                        c->merges, c->mshr_stalls, s->store_stalls);
+                printf("prefetch  : %s, %" PRIu64 " issued, %" PRIu64 " useful, %" PRIu64 " late, %" PRIu64 " useless, %" PRIu64 " dropped\n",
+                        prefetch_names[ep->l1d.prefetch], c->pf_issued, c->pf_useful, c->pf_late, c->pf_useless, c->pf_dropped);
+                printf("prefetch  : accuracy %.2f%%, coverage %.2f%%, timeliness %.2f%%\n",
+                        c->pf_issued ? 100.0 * used / c->pf_issued : 0.0,
+                        used + c->misses ? 100.0 * used / (used + c->misses) : 0.0,
+                        used ? 100.0 * c->pf_useful / used : 0.0);
+                printf("next level: %" PRIu64 " lines, %" PRIu64 " bytes\n",
+                        c->fills + c->pf_issued, (c->fills + c->pf_issued) * ep->l1d.line_size);
+                if (ep->l1d.coherence)
+                        printf("coherence : %s, %" PRIu64 " c2c transfers, %" PRIu64 " upgrades, %" PRIu64 " invalidations sent, "
+                                "%" PRIu64 " lines invalidated, %" PRIu64 " upgrade stalls\n",
+                                coh_names[ep->l1d.coherence], c->coh_c2c, c->coh_upgrades, c->coh_invals,
+                                c->coh_snooped, c->coh_stalls);
+        }
+        printf("branches  : %" PRIu64 ", %" PRIu64 " mispredicted, %" PRIu64 " without checkpoint\n",
+                s->branches, s->mispredicts, s->ckpt_misses);
+        printf("recovery  : %" PRIu64 " checkpoint, %" PRIu64 " walk, %" PRIu64 " cycles, %" PRIu64 " squashed\n",
+                s->ckpt_recoveries, s->walk_recoveries, s->recovery_cycles, s->squashed);
+        if (ep->frontend != FRONTEND_INTEGRATED)
+                printf("frontend  : %s, ring of %d, %" PRIu64 " cycles waiting for a redirect\n",
+                        frontend_names[ep->frontend], ep->ring_size, s->trace_waits);
+        if (ep->trace)
+                printf("trace     : %s, %" PRIu64 " records, %" PRIu64 " bytes (%.3f bytes/inst)\n",
+                        ep->trace, s->trace_records, s->trace_bytes,
+                        s->trace_records ? (double)s->trace_bytes / s->trace_records : 0.0);
+        for (int p = 0; ep->fusion && p < NB_FUSIONS; p++)
+                if (ep->fusion & (1 << p))
+                        printf("fusion    : %-10s %" PRIu64 " hits\n", fusion_names[p], s->fusion_hits[p]);
+        if (ep->roi != ROI_OFF)
+                printf("roi       : %s, %" PRIu64 " regions, %" PRIu64 " dumps, %" PRIu64 " fast-forwarded instructions\n",
+                        roi_names[ep->roi], s->roi_regions, s->roi_dumps, s->fast_forwarded);
+}
+
+
 // TODO:
 // argument --config: Specify a configuration file for engine parameters
 // no arguments : name of the program to execute
 int main(int argc, char *argv[]) {
 
-        // TODO: Verify ARGUMENTS
         //elf_open(argv[0], &ef);
 
         struct engine_parameters ep = {
@@ -25,21 +342,286 @@ int main(int argc, char *argv[]) {
                 .exb_size = 8,
                 .rob_size = 64,
                 .reg_size = 32,
+                .rename_mode = RENAME_ROB,
+                .prf_size = 0,
                 .cdb_size = 1,
-                .nb_units = 2,
-                .program = argv[1]
+                .cdb_policy = CDB_FIXED,
+                .cdb_lookahead = false,
+                .dispatch_width = 1,
+                .pool = {
+                        [UNIT_ALU] = {.count = 2, .latency = 1, .interval = 1},
+                        [UNIT_MUL] = {.count = 1, .latency = MUL_LATENCY, .interval = 1},
+                        [UNIT_DIV] = {.count = 1, .latency = DIV_LATENCY, .interval = DIV_LATENCY},
+                        [UNIT_AGU] = {.count = 1, .latency = 1, .interval = 1},
+                        [UNIT_BRU] = {.count = 1, .latency = 1, .interval = 1},
+                },
+                .lb_size = 8,
+                .sb_size = 8,
+                .mem_latency = 1,
+                .l1d = {
+                        .size = 0,
+                        .ways = 4,
+                        .line_size = 64,
+                        .hit_latency = 1,
+                        .nb_mshr = 0,
+                        .prefetch = PREFETCH_NONE,
+                        .degree = 1,
+                        .distance = 1,
+                        .coherence = COH_NONE,
+                        .c2c_latency = 10,
+                        .inv_latency = 10,
+                        .core = 0,
+                },
+                .wcb_size = 0,
+                .wcb_drain = 1,
+                .amo_latency = 1,
+                .mdp_policy = MDP_CONSERVATIVE,
+                .ssit_size = 1024,
+                .lfst_size = 128,
+                .nb_ckpt = 4,
+                .recover_latency = 1,
+                .walk_width = 4,
+                .frontend = FRONTEND_INTEGRATED,
+                .ring_size = 4096,
+                .trace = NULL,
+                .core = 0,
+                .nb_cores = 1,
+                .fusion = 0,
+                .select_policy = SELECT_OLDEST,
+                .program = NULL
         };
-        engine_init(&ep);
+        uint64_t max_cycles = 0;
+        int nb_cores = 1;
+        int quantum = 1000;
+
+        int opt;
+        while((opt = getopt(argc, argv, "m:e:r:c:a:LW:u:U:l:t:M:C:p:B:A:d:S:P:s:k:R:w:f:F:N:Q:O:i:H:g:y:xV:n:h")) != -1) {
+                switch(opt) {
+                        case 'm': ep.mem_size = strtol(optarg, NULL, 0); break;
+                        case 'e': ep.exb_size = strtol(optarg, NULL, 0); break;
+                        case 'r': ep.rob_size = strtol(optarg, NULL, 0); break;
+                        case 'c': ep.cdb_size = strtol(optarg, NULL, 0); break;
+                        case 'a':
+                                if ((opt = parse_name(cdb_names, 3, optarg)) < 0) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                ep.cdb_policy = opt;
+                                break;
+                        case 'L': ep.cdb_lookahead = true; break;
+                        case 'W': ep.dispatch_width = strtol(optarg, NULL, 0); break;
+                        case 'u': ep.pool[UNIT_ALU].count = strtol(optarg, NULL, 0); break;
+                        case 'l': ep.lb_size = strtol(optarg, NULL, 0); break;
+                        case 't': ep.sb_size = strtol(optarg, NULL, 0); break;
+                        case 'M': ep.mem_latency = strtol(optarg, NULL, 0); break;
+                        case 'C':
+                                if (sscanf(optarg, "%d:%d:%d:%d:%d", &ep.l1d.size, &ep.l1d.ways,
+                                                &ep.l1d.line_size, &ep.l1d.hit_latency, &ep.l1d.nb_mshr) < 1) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'p':
+                                if (parse_prefetch(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'B':
+                                if (sscanf(optarg, "%d:%d", &ep.wcb_size, &ep.wcb_drain) < 1) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'A': ep.amo_latency = strtol(optarg, NULL, 0); break;
+                        case 'd':
+                                if ((opt = parse_name(mdp_names, 3, optarg)) < 0) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                ep.mdp_policy = opt;
+                                break;
+                        case 'S':
+                                if (sscanf(optarg, "%d:%d", &ep.ssit_size, &ep.lfst_size) != 2) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'U':
+                                if (parse_pool(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'f':
+                                if (parse_fusion(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'P':
+                                ep.rename_mode = RENAME_PRF;
+                                ep.prf_size = strtol(optarg, NULL, 0);
+                                break;
+                        case 's':
+                                if ((opt = parse_name(select_names, 4, optarg)) < 0) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                ep.select_policy = opt;
+                                break;
+                        case 'k': ep.nb_ckpt = strtol(optarg, NULL, 0); break;
+                        case 'R': ep.recover_latency = strtol(optarg, NULL, 0); break;
+                        case 'w': ep.walk_width = strtol(optarg, NULL, 0); break;
+                        case 'F':
+                                if (parse_frontend(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'O':
+                                if (parse_coherence(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'i':
+                                if ((opt = parse_name(roi_names, 3, optarg)) < 0) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                ep.roi = opt;
+                                break;
+                        case 'H':
+                                ep.profile = strcmp(optarg, "all") ? strtol(optarg, NULL, 0) : -1;
+                                break;
+                        case 'g':
+                                if (!strcmp(optarg, "gprof")) {
+                                        ep.functions = PROF_GPROF;
+                                } else if (!strncmp(optarg, "folded:", 7) && optarg[7]) {
+                                        ep.functions = PROF_FOLDED;
+                                        ep.folded = optarg + 7;
+                                } else {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'y': ep.symbols = optarg; break;
+                        case 'x': ep.critical = true; break;
+                        case 'V':
+                                if (parse_vcd(&ep, optarg)) {
+                                        usage(argv[0]);
+                                        return EINVAL;
+                                }
+                                break;
+                        case 'N': nb_cores = strtol(optarg, NULL, 0); break;
+                        case 'Q': quantum = strtol(optarg, NULL, 0); break;
+                        case 'n': max_cycles = strtoull(optarg, NULL, 0); break;
+                        default:
+                                usage(argv[0]);
+                                return EINVAL;
+                }
+        }
+
+        if (nb_cores < 1 || nb_cores > MEM_MAX_CORES) {
+                usage(argv[0]);
+                return EINVAL;
+        }
+
+        // The cores of a cluster share the engine memory, a functional
+        // thread would run on its own copy
+        if (nb_cores > 1 && ep.frontend != FRONTEND_INTEGRATED) {
+                fprintf(stderr, "A cluster of cores needs the integrated frontend\n");
+                return EINVAL;
+        }
+
+        // A single L1D has no copies to keep coherent
+        if (nb_cores == 1 && ep.l1d.coherence != COH_NONE) {
+                fprintf(stderr, "A coherence protocol needs a cluster of 2 cores or more\n");
+                return EINVAL;
+        }
+
+        // A replayed trace stands for the program
+        if (ep.frontend == FRONTEND_REPLAY) {
+                ep.program = ep.trace;
+        } else if(optind >= argc) {
+                usage(argv[0]);
+                return EINVAL;
+        } else {
+                ep.program = argv[optind];
+        }
 
-        while((retval = engine_run()) == 0);
+        struct engine_stats s[MEM_MAX_CORES];
+        char *profile[MEM_MAX_CORES] = {NULL};
+        struct timespec start, end;
 
+        if (nb_cores > 1) {
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                if((retval = smp_run(&ep, nb_cores, quantum, max_cycles, s, profile))) {
+                        fprintf(stderr, "Could not run %d cores with program %s\n", nb_cores, ep.program);
+                        return retval;
+                }
+                clock_gettime(CLOCK_MONOTONIC, &end);
+        } else {
+                if((retval = engine_init(&ep))) {
+                        fprintf(stderr, "Could not initialize engine with program %s\n", ep.program);
+                        return retval;
+                }
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                uint64_t cycles = 0;
+                do {
+                        retval = engine_run();
+                } while(retval == 0 && (max_cycles == 0 || ++cycles < max_cycles));
+                clock_gettime(CLOCK_MONOTONIC, &end);
+
+                if (retval < 0) {
+                        fprintf(stderr, "Could not run program %s\n", ep.program);
+                        engine_destroy();
+                        return -retval;
+                }
+                engine_get_stats(&s[0]);
+        }
+
+        // Simulated performance and simulator speed
+        double host = elapsed(&start, &end);
+        uint64_t instret = 0, cycles = 0, simulated = 0;
+        struct engine_stats d;
+
+        printf("program   : %s\n", ep.program);
+        for (int i = 0; i < nb_cores; i++) {
+                if (nb_cores > 1)
+                        printf("core      : %d\n", i);
+                print_stats(&ep, &s[i]);
+                if (nb_cores == 1)
+                        engine_profile(stdout);
+                if (profile[i]) {
+                        fputs(profile[i], stdout);
+                        free(profile[i]);
+                }
+                instret += s[i].instret;
+                simulated += s[i].instret + s[i].fast_forwarded;
+                cycles = s[i].cycles > cycles ? s[i].cycles : cycles;
+        }
+        if (nb_cores > 1)
+                printf("cluster   : %d cores, quantum %d, %" PRIu64 " instret in %" PRIu64 " cycles, ipc %.3f\n",
+                        nb_cores, quantum, instret, cycles, cycles ? (double)instret / cycles : 0.0);
+
+        // Counters saved by the ROI_DUMP markers
+        for (int i = 0; nb_cores == 1 && engine_get_dump(i, &d) == 0; i++) {
+                printf("dump      : %d\n", i);
+                print_stats(&ep, &d);
+        }
+        printf("host time : %.6f s\n", host);
+        printf("sim speed : %.1f KIPS\n", host > 0 ? simulated / host / 1e3 : 0.0);
+
+        retval = retval < 0 ? retval : 0;
+
+        if (nb_cores > 1)
+                return retval;
 
-CLEANUP:
 //        elf_close(&ef);
-        mem_destroy();
         engine_destroy();
 
         return retval;
 }
-
-
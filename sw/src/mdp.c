@@ -0,0 +1,93 @@
+#include "mdp.h"
+
+const char *mdp_names[] = {
+        [MDP_CONSERVATIVE] = "conservative",
+        [MDP_SPECULATE]    = "speculate",
+        [MDP_STORE_SETS]   = "store-sets",
+};
+
+
+static CORE_LOCAL struct mdp {
+        int ssit_size;
+        int *ssit;              // Store set of a PC, -1 if none
+
+        int lfst_size;
+        struct lfst {
+                uint32_t seq;   // Last store of the set dispatched
+                bool valid;
+        } *lfst;
+} mdp = {0};
+
+
+static int ssit_index(uint32_t pc) {
+        return (pc >> 2) % mdp.ssit_size;
+}
+
+
+void mdp_destroy(void) {
+        if(mdp.ssit) free(mdp.ssit);
+        if(mdp.lfst) free(mdp.lfst);
+
+        mdp = (struct mdp) {0};
+}
+
+
+int mdp_create(int ssit_size, int lfst_size) {
+
+        if (ssit_size < 1 || lfst_size < 1)
+                return EINVAL;
+
+        mdp = (struct mdp) {
+                .ssit_size = ssit_size,
+                .ssit = malloc(sizeof(*mdp.ssit) * ssit_size),
+                .lfst_size = lfst_size,
+                .lfst = calloc(lfst_size, sizeof(*mdp.lfst)),
+        };
+
+        if(!mdp.ssit || !mdp.lfst)
+                goto CLEANUP;
+
+        for (int i = 0; i < ssit_size; i++)
+                mdp.ssit[i] = -1;
+
+        return 0;
+
+CLEANUP:
+        mdp_destroy();
+        return ENOMEM;
+}
+
+
+int mdp_load(uint32_t pc, uint32_t *seq) {
+        int ssid = mdp.ssit[ssit_index(pc)];
+
+        if (ssid < 0 || !mdp.lfst[ssid].valid)
+                return 0;
+
+        *seq = mdp.lfst[ssid].seq;
+        return 1;
+}
+
+
+void mdp_store(uint32_t pc, uint32_t seq) {
+        int ssid = mdp.ssit[ssit_index(pc)];
+
+        if (ssid >= 0)
+                mdp.lfst[ssid] = (struct lfst) { .seq = seq, .valid = true };
+}
+
+
+// A new set is named after the store, two sets are merged in the smallest
+void mdp_violation(uint32_t load_pc, uint32_t store_pc) {
+        int *l = &mdp.ssit[ssit_index(load_pc)];
+        int *s = &mdp.ssit[ssit_index(store_pc)];
+
+        if (*l < 0 && *s < 0)
+                *l = *s = ssit_index(store_pc) % mdp.lfst_size;
+        else if (*l < 0)
+                *l = *s;
+        else if (*s < 0 || *l < *s)
+                *s = *l;
+        else
+                *l = *s;
+}
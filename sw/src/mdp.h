@@ -0,0 +1,37 @@
+/* MEMORY DEPENDENCE PREDICTOR
+ * Store sets (Chrysos & Emer). The SSIT maps the PC of a load or store to
+ * the store set it belongs to, the LFST keeps the last store of each set
+ * that was dispatched. A load waits for the store of its set, the sets are
+ * built from the ordering violations.
+ */
+#ifndef __MDP_H__
+#define __MDP_H__
+
+#include "common.h"
+
+enum mdp_policy {
+        MDP_CONSERVATIVE,       // Loads wait for the address of every older store
+        MDP_SPECULATE,          // Loads never wait, violations are replayed
+        MDP_STORE_SETS          // Loads wait for the stores predicted by their store set
+};
+
+int mdp_create(int ssit_size, int lfst_size);
+
+void mdp_destroy(void);
+
+/* \fn mdp_load
+ * \param pc Address of the load
+ * \param seq Sequence number of the store the load must wait for
+ * \return 1 if the load belongs to a store set with a store in flight
+ */
+int mdp_load(uint32_t pc, uint32_t *seq);
+
+// Records the store as the last one dispatched for its set
+void mdp_store(uint32_t pc, uint32_t seq);
+
+// Puts the load and the store it bypassed in the same set
+void mdp_violation(uint32_t load_pc, uint32_t store_pc);
+
+extern const char *mdp_names[];
+
+#endif
@@ -1,7 +1,38 @@
 #include "mem.h"
+#include "unit.h"
+#include "RV32I.h"
 
-static uint8_t *mem;
-static int mem_size=0;
+static CORE_LOCAL uint8_t *mem;
+static CORE_LOCAL int mem_size=0;
+static CORE_LOCAL int mem_core = -1;    // Core whose stores are logged, -1 if not shared
+
+// Bytes stored by every core during the current quantum
+static struct mem_log {
+        struct mem_byte {
+                uint32_t addr;
+                uint8_t value;
+        } *buf;
+        int nb;
+        int size;
+        int error;      // ENOMEM once a byte could not be logged
+} logs[MEM_MAX_CORES];
+static int nb_cores = 0;
+
+// LR/SC reservation and atomic waiting for the end of the quantum of every
+// core, written by the core during the quantum and by core 0 in between
+static struct mem_amo {
+        uint32_t resv;          // Reserved word
+        bool reserved;
+        bool pending;
+        bool done;
+        uint8_t op;
+        uint32_t addr, src;
+        uint32_t result;        // Value of rd
+        uint32_t value;         // Value written to memory
+} amos[MEM_MAX_CORES];
+
+// Bytes written by the atomics of the quantum
+static struct mem_log atomics;
 
 int mem_create(int size) {
       mem = malloc(size);
@@ -19,24 +50,56 @@ void mem_destroy(void) {
         free(mem);
         mem = NULL;
         mem_size = 0;
+        mem_core = -1;
 }
 
 
-int mem_write(int addr, void *data, size_t n) {
-    if (!data || !n || !mem)
+// Out of memory the other cores would never see the byte, the error stays
+// until the end of the run
+static int log_byte(struct mem_log *l, uint32_t addr, uint8_t value) {
+        if (l->nb == l->size) {
+                int size = l->size ? 2 * l->size : 1024;
+                struct mem_byte *buf = realloc(l->buf, sizeof(*buf) * size);
+
+                if (!buf)
+                        return l->error = ENOMEM;
+
+                l->buf = buf;
+                l->size = size;
+        }
+
+        l->buf[l->nb++] = (struct mem_byte) {addr, value};
+
         return 0;
+}
 
+
+static void write_bytes(int addr, void *data, size_t n) {
     uint8_t *d = (uint8_t*)data;
 
     if (IS_LITTLE_ENDIAN) {
         for (uint32_t i = 0; i < n; i += 1) {
-            mem[(addr + i) % mem_size] = d[i];
+            mem[((uint32_t)addr + i) % mem_size] = d[i];
         }
     } else {
         for (uint32_t i = 0; i < n; i += 1) {
-            mem[(addr + i) % mem_size] = d[n - 1 - i];
+            mem[((uint32_t)addr + i) % mem_size] = d[n - 1 - i];
         }
     }
+}
+
+
+int mem_write(int addr, void *data, size_t n) {
+    if (!data || !n || !mem)
+        return 0;
+
+    write_bytes(addr, data, n);
+
+    if (mem_core >= 0)
+        for (uint32_t i = 0; i < n; i += 1)
+            if (log_byte(&logs[mem_core], ((uint32_t)addr + i) % mem_size, mem[((uint32_t)addr + i) % mem_size]))
+                return -ENOMEM;
+
     return n;
 }
 
@@ -49,13 +112,179 @@ int mem_read(int addr, void *data, size_t n) {
 
     if (IS_LITTLE_ENDIAN) {
         for (uint32_t i = 0; i < n; i += 1) {
-            d[i] = mem[(addr + i) % mem_size];
+            d[i] = mem[((uint32_t)addr + i) % mem_size];
         }
     } else {
         for (uint32_t i = 0; i < n; i += 1) {
-            d[n - 1 - i] = mem[(addr + i) % mem_size];
+            d[n - 1 - i] = mem[((uint32_t)addr + i) % mem_size];
         }
     }
 
     return n;
 }
+
+
+int mem_share(int n) {
+        if (n < 1 || n > MEM_MAX_CORES)
+                return EINVAL;
+
+        nb_cores = n;
+
+        return 0;
+}
+
+
+void mem_unshare(void) {
+        for (int i = 0; i < nb_cores; i++) {
+                if (logs[i].buf)
+                        free(logs[i].buf);
+                logs[i] = (struct mem_log) {0};
+                amos[i] = (struct mem_amo) {0};
+        }
+
+        if (atomics.buf)
+                free(atomics.buf);
+        atomics = (struct mem_log) {0};
+
+        nb_cores = 0;
+}
+
+
+void mem_set_core(int id) {
+        mem_core = id < nb_cores ? id : -1;
+        amos[mem_core < 0 ? 0 : mem_core] = (struct mem_amo) {0};
+}
+
+
+int mem_sync(void) {
+        for (int c = 0; c < nb_cores; c++)
+                if (logs[c].error)
+                        return logs[c].error;
+
+        for (int c = 0; c < nb_cores && mem; c++)
+                for (int i = 0; i < logs[c].nb; i++)
+                        mem[logs[c].buf[i].addr] = logs[c].buf[i].value;
+
+        return 0;
+}
+
+
+void mem_clear_log(void) {
+        if (mem_core >= 0)
+                logs[mem_core].nb = 0;
+}
+
+
+// Performs an atomic on the copy of the calling thread, returns 1 if it
+// writes the word
+static int perform(struct mem_amo *a) {
+        uint32_t old;
+
+        mem_read(a->addr, &old, 4);
+
+        switch (a->op) {
+                case FUNCT5_LR:
+                        a->resv = a->addr;
+                        a->reserved = true;
+                        a->result = old;
+                        return 0;
+
+                case FUNCT5_SC:
+                        a->result = !(a->reserved && a->resv == a->addr);
+                        a->reserved = false;
+                        a->value = a->src;
+                        return !a->result;
+
+                default:
+                        a->result = old;
+                        a->value = amo_exec(a->op, old, a->src);
+                        return 1;
+        }
+}
+
+
+// Breaks the reservations of the cores other than c on the word of a byte
+static void unreserve(int c, uint32_t addr) {
+        for (int k = 0; k < nb_cores; k++)
+                if (k != c && amos[k].reserved && amos[k].resv == (addr & ~3u))
+                        amos[k].reserved = false;
+}
+
+
+int mem_amo(uint8_t op, uint32_t addr, uint32_t src, uint32_t *result) {
+        struct mem_amo *a = &amos[mem_core < 0 ? 0 : mem_core];
+
+        a->op = op;
+        a->addr = addr & ~3u;
+        a->src = src;
+
+        if (mem_core >= 0 && op != FUNCT5_LR) {
+                a->pending = true;
+                a->done = false;
+                return 0;
+        }
+
+        if (perform(a))
+                write_bytes(a->addr, &a->value, 4);
+
+        *result = a->result;
+        return 1;
+}
+
+
+int mem_amo_done(uint32_t *result) {
+        struct mem_amo *a = &amos[mem_core < 0 ? 0 : mem_core];
+
+        if (!a->done)
+                return 0;
+
+        a->done = false;
+        *result = a->result;
+        return 1;
+}
+
+
+void mem_atomics(void) {
+        bool reserved = false;
+
+        atomics.nb = 0;
+
+        for (int c = 0; c < nb_cores; c++)
+                reserved |= amos[c].reserved;
+
+        if (reserved)
+                for (int c = 0; c < nb_cores; c++)
+                        for (int i = 0; i < logs[c].nb; i++)
+                                unreserve(c, logs[c].buf[i].addr);
+
+        for (int c = 0; c < nb_cores; c++) {
+                struct mem_amo *a = &amos[c];
+
+                if (!a->pending)
+                        continue;
+
+                if (perform(a)) {
+                        write_bytes(a->addr, &a->value, 4);
+                        for (uint32_t i = 0; i < 4; i++)
+                                log_byte(&atomics, (a->addr + i) % mem_size, mem[(a->addr + i) % mem_size]);
+                        unreserve(c, a->addr);
+                }
+
+                a->pending = false;
+                a->done = true;
+        }
+}
+
+
+int mem_sync_atomics(void) {
+        if (atomics.error)
+                return atomics.error;
+
+        if (mem_core <= 0 || !mem)
+                return 0;
+
+        for (int i = 0; i < atomics.nb; i++)
+                mem[atomics.buf[i].addr] = atomics.buf[i].value;
+
+        return 0;
+}
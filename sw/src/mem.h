@@ -3,12 +3,59 @@
 
 #include "common.h"
 
+#define MEM_MAX_CORES   16
+
 int mem_create(int size);
 
 void mem_destroy(void);
 
+// Returns the bytes written, -ENOMEM if a core of a cluster could not log
+// them for the others
 int mem_write(int addr, void *data, size_t n);
 
 int mem_read(int addr, void *data, size_t n);
 
+// Cores of a cluster each get a copy of the memory and log their stores,
+// the copies are merged at the end of every quantum
+int mem_share(int nb_cores);
+
+void mem_unshare(void);
+
+// Logs the stores of the calling thread as core id
+void mem_set_core(int id);
+
+/* \fn mem_sync
+ * \brief Applies the stores of every core in core order, once all cores
+ *        are done with the quantum. The last core to write a byte wins
+ * \return ENOMEM if a store of any core was lost, the run must stop. Every
+ *         core gets the same status, even without a memory of its own
+ */
+int mem_sync(void);
+
+// Empties the log of the calling core, once every core is synced
+void mem_clear_log(void);
+
+/* \fn mem_amo
+ * \brief Starts an atomic of the A extension on a word, op is its funct5.
+ *        A core alone performs it right away. In a cluster LR reads the copy
+ *        of the core, SC and the AMOs wait for the end of the quantum to be
+ *        performed in core order so every core sees them in the same order
+ * \return 1 if performed, result then holds the value of rd
+ */
+int mem_amo(uint8_t op, uint32_t addr, uint32_t src, uint32_t *result);
+
+// Returns 1 once the atomic of the calling core is performed
+int mem_amo_done(uint32_t *result);
+
+/* \fn mem_atomics
+ * \brief Called by core 0 after its mem_sync. The stores of the quantum
+ *        break the reservations of the other cores, then the atomics are
+ *        performed in core order on the copy of core 0
+ */
+void mem_atomics(void);
+
+// Applies the words written by the atomics to the copy of the calling core,
+// once core 0 performed them. ENOMEM for every core if one was lost
+int mem_sync_atomics(void);
+
 #endif
@@ -0,0 +1,218 @@
+/* Useage
+ * INIT: prf_create
+ * FREE: prf_destroy
+ *
+ * dispatch: read sources -> rename destination
+ * write back: write -> commit: update architectural map & free previous preg
+ * branch: checkpoint -> mispredict: restore, or undo every younger rename
+ */
+
+#include "prf.h"
+
+static CORE_LOCAL struct prf {
+        int size;
+        int nb_arch;
+
+        int32_t *x;     // Physical register value
+        bool *r;        // Physical register ready flag
+
+        tag_t *map;     // Speculative map: architectural -> physical
+        tag_t *arch;    // Committed map: architectural -> physical
+
+        // Free list, circular fifo of physical registers
+        tag_t *free;
+        int free_head;
+        int free_tail;
+        int free_cnt;
+
+        // Checkpoints: speculative map and free list head, registers
+        // allocated after the checkpoint go back to the free list on restore
+        int nb_ckpt;
+        tag_t *ckpt_map;
+        int *ckpt_head;
+} prf = {0};
+
+
+int prf_create(int size, int nb_arch, int nb_ckpt) {
+        if (prf.size != 0 || size <= nb_arch || (uint64_t)size > TAG_COUNT)
+                return -1;
+
+        prf.x = calloc(size, sizeof(*prf.x));
+        prf.r = calloc(size, sizeof(*prf.r));
+        prf.map = malloc(sizeof(*prf.map) * nb_arch);
+        prf.arch = malloc(sizeof(*prf.arch) * nb_arch);
+        prf.free = malloc(sizeof(*prf.free) * size);
+        prf.ckpt_map = malloc(sizeof(*prf.ckpt_map) * (nb_arch * nb_ckpt + 1));
+        prf.ckpt_head = malloc(sizeof(*prf.ckpt_head) * (nb_ckpt + 1));
+
+        if (!prf.x || !prf.r || !prf.map || !prf.arch || !prf.free || !prf.ckpt_map || !prf.ckpt_head)
+                goto CLEANUP;
+
+        prf.size = size;
+        prf.nb_arch = nb_arch;
+        prf.nb_ckpt = nb_ckpt;
+
+        // Identity mapping at reset, x0 is p0 and is never renamed
+        for (int i = 0; i < nb_arch; i++) {
+                prf.map[i] = i;
+                prf.arch[i] = i;
+                prf.r[i] = true;
+        }
+
+        prf.free_cnt = 0;
+        for (int i = nb_arch; i < size; i++)
+                prf.free[prf.free_cnt++] = i;
+
+        prf.free_head = 0;
+        prf.free_tail = prf.free_cnt % size;
+
+        return 0;
+
+CLEANUP:
+        prf_destroy();
+        return -2;
+}
+
+
+void prf_destroy(void) {
+        if (prf.x) free(prf.x);
+        if (prf.r) free(prf.r);
+        if (prf.map) free(prf.map);
+        if (prf.arch) free(prf.arch);
+        if (prf.free) free(prf.free);
+        if (prf.ckpt_map) free(prf.ckpt_map);
+        if (prf.ckpt_head) free(prf.ckpt_head);
+
+        prf = (struct prf) {0};
+}
+
+
+// Returns the physical register of a source operand and 1 if its value is ready
+int prf_read(uint8_t addr, tag_t *preg, int32_t *data) {
+        if (addr >= prf.nb_arch || !preg || !data)
+                return 0;
+
+        *preg = prf.map[addr];
+        *data = prf.x[*preg];
+
+        return prf.r[*preg];
+}
+
+
+// Allocates a new physical register for the destination, returns the previous
+// mapping so it can be freed on commit
+int prf_rename(uint8_t addr, tag_t *preg, tag_t *prev) {
+        if (addr >= prf.nb_arch || !preg || !prev)
+                return 0;
+
+        // x0 is hardwired, no allocation
+        if (addr == 0) {
+                *preg = 0;
+                *prev = 0;
+                return 1;
+        }
+
+        if (prf.free_cnt == 0)
+                return 0;
+
+        *prev = prf.map[addr];
+        *preg = prf.free[prf.free_head];
+
+        prf.free_head = (prf.free_head + 1) % prf.size;
+        prf.free_cnt -= 1;
+
+        prf.map[addr] = *preg;
+        prf.r[*preg] = false;
+
+        return 1;
+}
+
+
+int prf_write(tag_t preg, int32_t data) {
+        if (preg >= prf.size || preg == 0)
+                return 0;
+
+        prf.x[preg] = data;
+        prf.r[preg] = true;
+
+        return 1;
+}
+
+
+int prf_commit(uint8_t addr, tag_t preg, tag_t prev) {
+        if (addr >= prf.nb_arch || addr == 0)
+                return 0;
+
+        prf.arch[addr] = preg;
+
+        // Previous mapping can no longer be read by anyone
+        prf.free[prf.free_tail] = prev;
+        prf.free_tail = (prf.free_tail + 1) % prf.size;
+        prf.free_cnt += 1;
+
+        return 1;
+}
+
+
+// Undoes the rename of a squashed instruction, renames must be undone from
+// the youngest to the oldest so the free list head moves back in order
+int prf_undo(uint8_t addr, tag_t preg, tag_t prev) {
+        if (addr >= prf.nb_arch || addr == 0)
+                return 0;
+
+        prf.map[addr] = prev;
+
+        prf.free_head = (prf.free_head + prf.size - 1) % prf.size;
+        prf.free[prf.free_head] = preg;
+        prf.free_cnt += 1;
+
+        return 1;
+}
+
+
+int prf_checkpoint(int id) {
+        if (id < 0 || id >= prf.nb_ckpt)
+                return 0;
+
+        memcpy(&prf.ckpt_map[id * prf.nb_arch], prf.map, sizeof(*prf.map) * prf.nb_arch);
+        prf.ckpt_head[id] = prf.free_head;
+
+        return 1;
+}
+
+
+int prf_restore(int id) {
+        if (id < 0 || id >= prf.nb_ckpt)
+                return 0;
+
+        memcpy(prf.map, &prf.ckpt_map[id * prf.nb_arch], sizeof(*prf.map) * prf.nb_arch);
+
+        // Registers allocated since the checkpoint are free again
+        prf.free_cnt += (prf.free_head - prf.ckpt_head[id] + prf.size) % prf.size;
+        prf.free_head = prf.ckpt_head[id];
+
+        return 1;
+}
+
+
+int prf_free(void) {
+        return prf.free_cnt;
+}
+
+
+int prf_full(void) {
+        if (prf.free_cnt == 0)
+                return 1;
+
+        return 0;
+}
+
+
+void prf_print(void) {
+
+    printf("---------------------\n");
+    for(int i = 0; i < prf.nb_arch; i++)
+        printf("| x%d | p%d | %0#x |\n", i, prf.arch[i], prf.x[prf.arch[i]]);
+    printf("---------------------\n");
+
+}
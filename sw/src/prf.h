@@ -0,0 +1,43 @@
+/* PRF
+ * Merged physical register file with a rename map table and a free list.
+ * Results are written once in the PRF, the ROB only tracks the mapping so
+ * commit updates the architectural map without copying values.
+ */
+#ifndef __PRF_H__
+#define __PRF_H__
+
+#include "common.h"
+
+/* \fn prf_create
+ * \param size Number of physical registers
+ * \param nb_arch Number of architectural registers
+ * \param nb_ckpt Number of checkpoints of the rename map
+ * \return -1 if size <= nb_arch, size does not fit in a tag or current prf
+ *         not deallocated
+ *         -2 memory error
+ */
+int prf_create(int size, int nb_arch, int nb_ckpt);
+
+void prf_destroy(void);
+
+int prf_read(uint8_t addr, tag_t *preg, int32_t *data);
+
+int prf_rename(uint8_t addr, tag_t *preg, tag_t *prev);
+
+int prf_write(tag_t preg, int32_t data);
+
+int prf_commit(uint8_t addr, tag_t preg, tag_t prev);
+
+int prf_undo(uint8_t addr, tag_t preg, tag_t prev);
+
+int prf_checkpoint(int id);
+
+int prf_restore(int id);
+
+int prf_free(void);
+
+int prf_full(void);
+
+void prf_print(void);
+
+#endif
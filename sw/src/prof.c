@@ -0,0 +1,562 @@
+#include "prof.h"
+#include "disasm.h"
+#include "decoder.h"
+#include <inttypes.h>
+#include <string.h>
+
+#define PROF_MIN_BITS   10
+#define PROF_MIN_NODES  64
+#define PROF_ROOT       -2      // Function of the root of the calling context tree
+
+// Control flow of the last committed instruction
+enum prof_flow {
+        FLOW_NONE,
+        FLOW_CALL,
+        FLOW_RETURN
+};
+
+static CORE_LOCAL struct prof {
+        int bits;               // The table has 2^bits slots, open addressing
+        int count;              // Addresses in the table
+        struct prof_pc {
+                uint32_t pc;
+                uint32_t inst;
+                bool used;
+                uint64_t n[NB_PROF_EVENTS];
+        } *table;
+
+        int rob_size;
+        struct prof_rob {
+                uint32_t pc;
+                uint64_t cycle; // Dispatched at
+        } *rob;
+
+        bool on;
+
+        // Functions, sorted by address
+        int nb_sym;
+        struct elf_symbol *sym;
+
+        // Calling context tree, node 0 is the root
+        int nb_nodes, max_nodes;
+        struct prof_node {
+                int func;       // Symbol, -1 outside of every function
+                int parent;
+                int child;      // First child, -1 without any
+                int next;       // Next sibling
+                uint64_t calls;
+                uint64_t cycles;
+                uint64_t retired;
+        } *node;
+        int cur;                // Context of the last committed instruction
+        enum prof_flow flow;
+} prof = {0};
+
+
+void prof_destroy(void) {
+        if (prof.table)
+                free(prof.table);
+        if (prof.rob)
+                free(prof.rob);
+        if (prof.node)
+                free(prof.node);
+        elf_free_symbols(prof.sym, prof.nb_sym);
+
+        prof = (struct prof) {0};
+}
+
+
+int prof_create(int rob_size) {
+        prof = (struct prof) {
+                .bits = PROF_MIN_BITS,
+                .table = calloc(1 << PROF_MIN_BITS, sizeof(*prof.table)),
+                .rob_size = rob_size,
+                .rob = calloc(rob_size, sizeof(*prof.rob)),
+                .max_nodes = PROF_MIN_NODES,
+                .node = malloc(PROF_MIN_NODES * sizeof(*prof.node)),
+        };
+
+        if (!prof.table || !prof.rob || !prof.node) {
+                prof_destroy();
+                return ENOMEM;
+        }
+
+        prof.node[0] = (struct prof_node) {.func = PROF_ROOT, .child = -1, .next = -1};
+        prof.nb_nodes = 1;
+
+        return 0;
+}
+
+
+void prof_enable(bool on) {
+        prof.on = on;
+}
+
+
+void prof_symbols(struct elf_symbol *sym, int nb_sym) {
+        int n = 0;
+        bool typed = false;
+
+        for (int i = 0; i < nb_sym; i++)
+                typed |= sym[i].func;
+
+        // The labels inside the functions are dropped when the functions
+        // are typed, like the loops of a compiled program
+        for (int i = 0; i < nb_sym; i++) {
+                if (typed && !sym[i].func)
+                        free(sym[i].name);
+                else
+                        sym[n++] = sym[i];
+        }
+
+        elf_free_symbols(prof.sym, prof.nb_sym);
+        prof.sym = sym;
+        prof.nb_sym = n;
+}
+
+
+static uint32_t slot(uint32_t pc, int bits) {
+        return ((pc >> 2) * 0x9E3779B1u) >> (32 - bits);
+}
+
+
+// Doubles the table, the addresses are inserted again
+static int grow(void) {
+        int bits = prof.bits + 1;
+        uint32_t mask = (1u << bits) - 1;
+        struct prof_pc *t = calloc(1 << bits, sizeof(*t));
+
+        if (!t)
+                return ENOMEM;
+
+        for (int i = 0; i < 1 << prof.bits; i++) {
+                if (!prof.table[i].used)
+                        continue;
+
+                uint32_t j = slot(prof.table[i].pc, bits);
+                while (t[j].used)
+                        j = (j + 1) & mask;
+                t[j] = prof.table[i];
+        }
+
+        free(prof.table);
+        prof.table = t;
+        prof.bits = bits;
+
+        return 0;
+}
+
+
+// Entry of an address, added if needed. Returns NULL without memory
+static struct prof_pc *lookup(uint32_t pc) {
+        uint32_t mask = (1u << prof.bits) - 1;
+        uint32_t i = slot(pc, prof.bits);
+
+        while (prof.table[i].used && prof.table[i].pc != pc)
+                i = (i + 1) & mask;
+
+        if (prof.table[i].used)
+                return &prof.table[i];
+
+        // Kept at most half full
+        if (2 * (prof.count + 1) > 1 << prof.bits)
+                return grow() ? NULL : lookup(pc);
+
+        prof.table[i] = (struct prof_pc) {.pc = pc, .used = true};
+        prof.count++;
+
+        return &prof.table[i];
+}
+
+
+void prof_dispatch(tag_t rob, uint32_t pc, uint32_t inst, uint64_t cycle) {
+        struct prof_pc *p = lookup(pc);
+
+        if (p)
+                p->inst = inst;
+
+        prof.rob[rob] = (struct prof_rob) {.pc = pc, .cycle = cycle};
+}
+
+
+// Function of an address, the last symbol before it. -1 before the first
+// one or past the end of a sized function
+static int function(uint32_t pc) {
+        int lo = 0, hi = prof.nb_sym - 1, f = -1;
+
+        while (lo <= hi) {
+                int m = (lo + hi) / 2;
+
+                if (prof.sym[m].addr <= pc) {
+                        f = m;
+                        lo = m + 1;
+                } else {
+                        hi = m - 1;
+                }
+        }
+
+        if (f >= 0 && prof.sym[f].size && pc - prof.sym[f].addr >= prof.sym[f].size)
+                return -1;
+
+        return f;
+}
+
+
+static bool inside(int f, uint32_t pc) {
+        if (f < 0)
+                return false;
+
+        uint32_t end = prof.sym[f].size ? prof.sym[f].addr + prof.sym[f].size
+                : f + 1 < prof.nb_sym ? prof.sym[f + 1].addr : UINT32_MAX;
+
+        return pc >= prof.sym[f].addr && pc < end;
+}
+
+
+// Context of func called from parent, added if needed. Returns parent
+// without memory
+static int child(int parent, int func) {
+        for (int c = prof.node[parent].child; c >= 0; c = prof.node[c].next)
+                if (prof.node[c].func == func)
+                        return c;
+
+        if (prof.nb_nodes == prof.max_nodes) {
+                struct prof_node *node = realloc(prof.node, 2 * prof.max_nodes * sizeof(*node));
+
+                if (!node)
+                        return parent;
+                prof.node = node;
+                prof.max_nodes *= 2;
+        }
+
+        int n = prof.nb_nodes++;
+
+        prof.node[n] = (struct prof_node) {.func = func, .parent = parent, .child = -1, .next = prof.node[parent].child};
+        prof.node[parent].child = n;
+
+        return n;
+}
+
+
+// Context of the next committed address, after the call or return of the
+// instruction committed before it
+static int context(uint32_t pc) {
+        if (prof.flow == FLOW_CALL) {
+                prof.cur = child(prof.cur, function(pc));
+                prof.node[prof.cur].calls++;
+        } else if (prof.flow == FLOW_RETURN && prof.node[prof.cur].parent > 0) {
+                prof.cur = prof.node[prof.cur].parent;
+        }
+        prof.flow = FLOW_NONE;
+
+        // Jumps to another function without a call, like a tail call,
+        // replace the top of the stack
+        if (!inside(prof.node[prof.cur].func, pc)) {
+                int f = function(pc);
+
+                if (f != prof.node[prof.cur].func)
+                        prof.cur = child(prof.cur ? prof.node[prof.cur].parent : 0, f);
+        }
+
+        return prof.cur;
+}
+
+
+void prof_count(uint32_t pc, enum prof_event e, uint64_t n) {
+        if (!prof.on)
+                return;
+
+        struct prof_pc *p = lookup(pc);
+
+        if (p)
+                p->n[e] += n;
+
+        if (e == PROF_CYCLES && prof.nb_sym)
+                prof.node[context(pc)].cycles += n;
+}
+
+
+void prof_count_rob(tag_t rob, enum prof_event e, uint64_t n) {
+        prof_count(prof.rob[rob].pc, e, n);
+}
+
+
+void prof_retire(tag_t rob) {
+        uint32_t pc = prof.rob[rob].pc;
+        struct prof_pc *p = lookup(pc);
+
+        if (p && prof.on)
+                p->n[PROF_RETIRED]++;
+
+        if (!p || !prof.nb_sym)
+                return;
+
+        int n = context(pc);
+        if (prof.on)
+                prof.node[n].retired++;
+
+        struct inst_field i = decode(p->inst);
+        bool link = i.rd == 1 || i.rd == 5;
+
+        if ((i.opcode == OP_JAL || i.opcode == OP_JALR) && link)
+                prof.flow = FLOW_CALL;
+        else if (i.opcode == OP_JALR && (i.rs1 == 1 || i.rs1 == 5))
+                prof.flow = FLOW_RETURN;
+}
+
+
+void prof_mispredict(tag_t rob, uint64_t cycle, int stall) {
+        prof_count_rob(rob, PROF_MISPREDICTS, 1);
+        prof_count_rob(rob, PROF_PENALTY, cycle - prof.rob[rob].cycle + stall);
+}
+
+
+// Most cycles first, then by address
+static int compare(const void *a, const void *b) {
+        const struct prof_pc *x = *(struct prof_pc * const *)a;
+        const struct prof_pc *y = *(struct prof_pc * const *)b;
+
+        if (x->n[PROF_CYCLES] != y->n[PROF_CYCLES])
+                return x->n[PROF_CYCLES] < y->n[PROF_CYCLES] ? 1 : -1;
+
+        return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+
+void prof_report(FILE *f, int rows) {
+        struct prof_pc **sorted = malloc(prof.count * sizeof(*sorted));
+        uint64_t total[NB_PROF_EVENTS] = {0};
+        char text[DISASM_SIZE];
+        int n = 0;
+
+        if (!sorted && prof.count)
+                return;
+
+        for (int i = 0; i < 1 << prof.bits; i++) {
+                if (!prof.table[i].used)
+                        continue;
+
+                sorted[n++] = &prof.table[i];
+                for (int e = 0; e < NB_PROF_EVENTS; e++)
+                        total[e] += prof.table[i].n[e];
+        }
+
+        qsort(sorted, n, sizeof(*sorted), compare);
+
+        if (rows < 0 || rows > n)
+                rows = n;
+
+        fprintf(f, "profile   : %d of %d addresses, %" PRIu64 " cycles\n", rows, n, total[PROF_CYCLES]);
+        fprintf(f, "%12s %7s %10s %10s %10s %8s %10s %10s  %-10s  %s\n",
+                "cycles", "%", "retired", "head", "exb", "mispred", "penalty", "l1d miss", "address", "instruction");
+
+        for (int i = 0; i < rows; i++) {
+                const struct prof_pc *p = sorted[i];
+
+                disasm(p->inst, p->pc, text);
+                fprintf(f, "%12" PRIu64 " %6.2f%% %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %10" PRIu64 " %10" PRIu64 "  0x%08" PRIx32 "  %s\n",
+                        p->n[PROF_CYCLES], total[PROF_CYCLES] ? 100.0 * p->n[PROF_CYCLES] / total[PROF_CYCLES] : 0.0,
+                        p->n[PROF_RETIRED], p->n[PROF_HEAD_STALLS], p->n[PROF_EXB_WAITS],
+                        p->n[PROF_MISPREDICTS], p->n[PROF_PENALTY], p->n[PROF_L1D_MISSES], p->pc, text);
+        }
+
+        free(sorted);
+}
+
+
+static const char *name(int f) {
+        return f == PROF_ROOT ? "<spontaneous>" : f < 0 ? "[unknown]" : prof.sym[f].name;
+}
+
+
+// Totals of a function, the addresses outside of every function are counted
+// after the last one
+struct prof_func {
+        uint64_t n[NB_PROF_EVENTS];     // Of its addresses
+        uint64_t calls;
+        uint64_t self;                  // Cycles of its contexts
+        uint64_t total;                 // With the functions it called
+        int index;                      // In the call graph, 0 if absent
+};
+
+// Calls from a function to another, with the cycles of the callee
+struct prof_arc {
+        int caller, callee;
+        uint64_t calls, self, children;
+};
+
+
+static CORE_LOCAL struct prof_func *sort_func;
+
+// Most cycles first, in the flat profile and then in the call graph
+static int compare_self(const void *a, const void *b) {
+        uint64_t x = sort_func[*(const int *)a].n[PROF_CYCLES], y = sort_func[*(const int *)b].n[PROF_CYCLES];
+
+        return x == y ? *(const int *)a - *(const int *)b : x < y ? 1 : -1;
+}
+
+
+static int compare_total(const void *a, const void *b) {
+        uint64_t x = sort_func[*(const int *)a].total, y = sort_func[*(const int *)b].total;
+
+        return x == y ? *(const int *)a - *(const int *)b : x < y ? 1 : -1;
+}
+
+
+static void print_arc(FILE *f, const struct prof_arc *a, int func, uint64_t calls, const struct prof_func *fn) {
+        int index = func == PROF_ROOT ? 0 : fn[func < 0 ? prof.nb_sym : func].index;
+
+        char self[24] = "", children[24] = "", ratio[48] = "";
+
+        // The time of a recursive call is already in the function
+        if (a->caller != a->callee) {
+                snprintf(self, sizeof(self), "%" PRIu64, a->self);
+                snprintf(children, sizeof(children), "%" PRIu64, a->children);
+        }
+        if (a->calls)
+                snprintf(ratio, sizeof(ratio), "%" PRIu64 "/%" PRIu64, a->calls, calls);
+
+        fprintf(f, "%6s %7s %10s %10s %14s      %s", "", "", self, children, ratio, name(func));
+        if (index)
+                fprintf(f, " [%d]", index);
+        fprintf(f, "\n");
+}
+
+
+void prof_functions(FILE *f) {
+        int nb = prof.nb_sym + 1, nb_arcs = 0;
+        struct prof_func *fn = calloc(nb, sizeof(*fn));
+        struct prof_arc *arc = calloc(prof.nb_nodes, sizeof(*arc));
+        uint64_t *sub = calloc(prof.nb_nodes, sizeof(*sub));
+        int *order = malloc(nb * sizeof(*order));
+
+        if (!prof.nb_sym || !fn || !arc || !sub || !order)
+                goto CLEANUP;
+
+        for (int i = 0; i < 1 << prof.bits; i++) {
+                int k = function(prof.table[i].pc);
+
+                for (int e = 0; prof.table[i].used && e < NB_PROF_EVENTS; e++)
+                        fn[k < 0 ? nb - 1 : k].n[e] += prof.table[i].n[e];
+        }
+
+        // A context is added after its parent, the children are summed first
+        for (int n = prof.nb_nodes - 1; n > 0; n--) {
+                sub[n] += prof.node[n].cycles;
+                sub[prof.node[n].parent] += sub[n];
+        }
+
+        for (int n = 1; n < prof.nb_nodes; n++) {
+                const struct prof_node *c = &prof.node[n];
+                struct prof_func *p = &fn[c->func < 0 ? nb - 1 : c->func];
+                int caller = prof.node[c->parent].func, a;
+                bool recursive = false;
+
+                for (int u = c->parent; u > 0 && !recursive; u = prof.node[u].parent)
+                        recursive = prof.node[u].func == c->func;
+
+                p->calls += c->calls;
+                p->self += c->cycles;
+                if (!recursive)
+                        p->total += sub[n];
+
+                for (a = 0; a < nb_arcs && (arc[a].caller != caller || arc[a].callee != c->func); a++);
+                if (a == nb_arcs)
+                        arc[nb_arcs++] = (struct prof_arc) {.caller = caller, .callee = c->func};
+                arc[a].calls += c->calls;
+                arc[a].self += c->cycles;
+                arc[a].children += sub[n] - c->cycles;
+        }
+
+        sort_func = fn;
+        for (int i = 0; i < nb; i++)
+                order[i] = i;
+
+        // Flat profile, from the addresses
+        qsort(order, nb, sizeof(*order), compare_self);
+
+        fprintf(f, "flat profile: %d functions, %" PRIu64 " cycles\n", prof.nb_sym, sub[0]);
+        fprintf(f, "%7s %12s %12s %10s %10s %8s %10s  %s\n",
+                "%", "self", "cumulative", "retired", "l1d miss", "mispred", "calls", "name");
+
+        uint64_t cumulative = 0;
+        for (int i = 0; i < nb; i++) {
+                const struct prof_func *p = &fn[order[i]];
+
+                if (!p->n[PROF_CYCLES] && !p->n[PROF_RETIRED] && !p->calls)
+                        continue;
+
+                cumulative += p->n[PROF_CYCLES];
+                fprintf(f, "%6.2f%% %12" PRIu64 " %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %8" PRIu64 " %10" PRIu64 "  %s\n",
+                        sub[0] ? 100.0 * p->n[PROF_CYCLES] / sub[0] : 0.0, p->n[PROF_CYCLES], cumulative,
+                        p->n[PROF_RETIRED], p->n[PROF_L1D_MISSES], p->n[PROF_MISPREDICTS], p->calls,
+                        name(order[i] == nb - 1 ? -1 : order[i]));
+        }
+
+        // Call graph, from the calling contexts
+        qsort(order, nb, sizeof(*order), compare_total);
+
+        int index = 0;
+        for (int i = 0; i < nb; i++)
+                if (fn[order[i]].total || fn[order[i]].calls)
+                        fn[order[i]].index = ++index;
+
+        fprintf(f, "\ncall graph: callers above and callees below every function\n");
+        fprintf(f, "%-6s %7s %10s %10s %14s      %s\n", "index", "% time", "self", "children", "called", "name");
+
+        for (int i = 0; i < index; i++) {
+                int k = order[i], func = k == nb - 1 ? -1 : k;
+                const struct prof_func *p = &fn[k];
+                char id[16], calls[24] = "";
+
+                for (int a = 0; a < nb_arcs; a++)
+                        if (arc[a].callee == func)
+                                print_arc(f, &arc[a], arc[a].caller, p->calls, fn);
+
+                snprintf(id, sizeof(id), "[%d]", p->index);
+                if (p->calls)
+                        snprintf(calls, sizeof(calls), "%" PRIu64, p->calls);
+                fprintf(f, "%-6s %6.2f%% %10" PRIu64 " %10" PRIu64 " %14s  %s %s\n", id,
+                        sub[0] ? 100.0 * p->total / sub[0] : 0.0, p->self, p->total - p->self, calls, name(func), id);
+
+                for (int a = 0; a < nb_arcs; a++)
+                        if (arc[a].caller == func && arc[a].calls)
+                                print_arc(f, &arc[a], arc[a].callee, fn[arc[a].callee < 0 ? nb - 1 : arc[a].callee].calls, fn);
+
+                fprintf(f, "-----------------------------------------------\n");
+        }
+
+CLEANUP:
+        if (fn)
+                free(fn);
+        if (arc)
+                free(arc);
+        if (sub)
+                free(sub);
+        if (order)
+                free(order);
+}
+
+
+void prof_folded(FILE *f) {
+        int *path = malloc(prof.nb_nodes * sizeof(*path));
+
+        if (!path)
+                return;
+
+        for (int n = 1; n < prof.nb_nodes; n++) {
+                int depth = 0;
+
+                if (!prof.node[n].cycles)
+                        continue;
+
+                for (int u = n; u > 0; u = prof.node[u].parent)
+                        path[depth++] = prof.node[u].func;
+
+                while (depth--)
+                        fprintf(f, "%s%c", name(path[depth]), depth ? ';' : ' ');
+                fprintf(f, "%" PRIu64 "\n", prof.node[n].cycles);
+        }
+
+        free(path);
+}
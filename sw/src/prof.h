@@ -0,0 +1,81 @@
+/* PROFILE
+ * Cycles of a core charged to the instruction addresses, like a profiler
+ * sampling every cycle. A cycle goes to the oldest instruction in flight,
+ * the ROB head, or to the next instruction to dispatch while the ROB is
+ * empty. The stalls are charged to the instruction responsible for them:
+ * the head that can't commit, the ops waiting in the EXB and the branches
+ * that mispredicted. The report is sorted by cycles and shows the
+ * disassembly of every address, like perf annotate.
+ *
+ * With the symbols of the program, the addresses are grouped by function
+ * and a calling context tree follows the committed calls and returns, with
+ * the conventions of the return address stack: a jump linking x1 or x5
+ * calls, a JALR through them without link returns. It gives a gprof like
+ * flat profile and call graph, or folded stacks for flame graphs.
+ */
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#include "common.h"
+#include "elf.h"
+#include <stdio.h>
+
+enum prof_event {
+        PROF_CYCLES,            // Cycles as the oldest instruction
+        PROF_RETIRED,
+        PROF_HEAD_STALLS,       // Cycles at the ROB head without committing
+        PROF_EXB_WAITS,         // Cycles in the EXB waiting for operands or a unit
+        PROF_MISPREDICTS,
+        PROF_PENALTY,           // Cycles from the dispatch of a mispredicted branch to the end of its recovery
+        PROF_L1D_MISSES,
+        NB_PROF_EVENTS
+};
+
+// Report per function
+enum prof_format {
+        PROF_NONE,
+        PROF_GPROF,             // Flat profile and call graph
+        PROF_FOLDED             // One line per calling context, for flamegraph.pl
+};
+
+int prof_create(int rob_size);
+
+void prof_destroy(void);
+
+// Events are dropped while off, the calls and returns are still followed
+void prof_enable(bool on);
+
+/* \fn prof_symbols
+ * \brief Groups the addresses by function, the profile keeps the symbols
+ *        and frees them
+ * \param sym Symbols sorted by address, as given by elf_symbols
+ */
+void prof_symbols(struct elf_symbol *sym, int nb_sym);
+
+// The instruction inst at pc was dispatched to the ROB entry rob
+void prof_dispatch(tag_t rob, uint32_t pc, uint32_t inst, uint64_t cycle);
+
+void prof_count(uint32_t pc, enum prof_event e, uint64_t n);
+
+// Charges the instruction of a ROB entry
+void prof_count_rob(tag_t rob, enum prof_event e, uint64_t n);
+
+// The instruction of a ROB entry committed
+void prof_retire(tag_t rob);
+
+// The branch of a ROB entry mispredicted, the frontend restarts after stall cycles
+void prof_mispredict(tag_t rob, uint64_t cycle, int stall);
+
+/* \fn prof_report
+ * \brief Prints the rows addresses with the most cycles, every address if
+ *        rows is negative
+ */
+void prof_report(FILE *f, int rows);
+
+// Flat profile and call graph of the functions
+void prof_functions(FILE *f);
+
+// Self cycles of every calling context, as f1;f2;f3 cycles
+void prof_folded(FILE *f);
+
+#endif
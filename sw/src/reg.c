@@ -1,26 +1,41 @@
 #include "reg.h"
 
-static struct reg {
+static CORE_LOCAL struct reg {
         int size;
         int32_t *x; // Register value
-        uint8_t *s; // Register src
-        bool *d;    // Register dirty flag (value is not valid in register)
+        tag_t *s;   // Register src
+        uint64_t d; // Scoreboard, bit set if the register is dirty (value is not valid in register)
+
+        // Checkpoints of the rename state (s & d), one slot per
+        // unresolved branch
+        int nb_ckpt;
+        tag_t *ckpt_s;
+        uint64_t *ckpt_d;
 } reg = {0};
 
 
-int reg_create(int size) {
+int reg_create(int size, int nb_ckpt) {
+        // The scoreboard holds one bit per register
+        if (size > 64)
+                return -1;
+
         reg.x = malloc(sizeof(*reg.x) * size);
 
         reg.s = calloc(size, sizeof(*reg.s));
 
-        reg.d = calloc(size, sizeof(*reg.d));
+        reg.d = 0;
+
+        reg.ckpt_s = calloc(size * nb_ckpt + 1, sizeof(*reg.ckpt_s));
+
+        reg.ckpt_d = calloc(nb_ckpt + 1, sizeof(*reg.ckpt_d));
 
-        if(!reg.x || !reg.s || !reg.d)
+        if(!reg.x || !reg.s || !reg.ckpt_s || !reg.ckpt_d)
                 goto CLEANUP;
 
         reg.x[0] = 0;
         reg.s[0] = 0;
         reg.size = size;
+        reg.nb_ckpt = nb_ckpt;
 
         return 0;
 
@@ -37,8 +52,11 @@ void reg_destroy(void) {
         if (reg.s)
                 free(reg.s);
 
-        if (reg.d)
-                free(reg.d);
+        if (reg.ckpt_s)
+                free(reg.ckpt_s);
+
+        if (reg.ckpt_d)
+                free(reg.ckpt_d);
 
         reg = (struct reg) {
                 .x = NULL,
@@ -66,34 +84,101 @@ int reg_write_data(uint8_t addr, int32_t data) {
         reg.x[addr] = data;
 
         // Clear dirty flag
-        reg.d[addr] = 0;
+        reg.d &= ~reg_bit(addr);
+
+        return 1;
+}
+
+
+// Writes a committed value, the register stays dirty if a younger
+// instruction has been renamed to it since
+int reg_commit(uint8_t addr, tag_t src, int32_t data) {
+        if(addr >= reg.size || addr == 0)
+                return 0;
+
+        reg.x[addr] = data;
+
+        if (reg.s[addr] == src)
+                reg.d &= ~reg_bit(addr);
+
+        // The value is also valid for the checkpoints still waiting on it,
+        // the saved source of a clean register is stale
+        for (int i = 0; i < reg.nb_ckpt; i++)
+                if ((reg.ckpt_d[i] & reg_bit(addr)) && reg.ckpt_s[i * reg.size + addr] == src)
+                        reg.ckpt_d[i] &= ~reg_bit(addr);
 
         return 1;
 }
 
 
-int reg_read_src(uint8_t addr, uint8_t *src) {
+int reg_read_src(uint8_t addr, tag_t *src) {
         if (addr >= reg.size || !src)
                 return 0;
 
         *src = reg.s[addr];
 
-        return reg.d[addr];
+        return (reg.d >> addr) & 1;
 }
 
 
-int reg_write_src(uint8_t addr, uint8_t src) {
+int reg_write_src(uint8_t addr, tag_t src) {
         if(addr >= reg.size || addr == 0)
                 return 0;
 
         reg.s[addr] = src;
 
         // set dirty flag
-        reg.d[addr] = 1;
+        reg.d |= reg_bit(addr);
+
+        return 1;
+}
+
+// Restores the source of a register when walking back a squashed rename
+int reg_undo(uint8_t addr, tag_t src, bool dirty) {
+        if(addr >= reg.size || addr == 0)
+                return 0;
+
+        reg.s[addr] = src;
+        reg.d = (reg.d & ~reg_bit(addr)) | ((uint64_t)dirty << addr);
+
+        return 1;
+}
+
+
+// The source of a clean register is never read, a checkpoint only saves
+// and restores those of the dirty registers, found from the scoreboard
+int reg_checkpoint(int id) {
+        if(id < 0 || id >= reg.nb_ckpt)
+                return 0;
+
+        tag_t *s = &reg.ckpt_s[id * reg.size];
+
+        for (uint64_t d = reg.d; d; d &= d - 1) {
+                int i = __builtin_ctzll(d);
+                s[i] = reg.s[i];
+        }
+        reg.ckpt_d[id] = reg.d;
+
+        return 1;
+}
+
+
+int reg_restore(int id) {
+        if(id < 0 || id >= reg.nb_ckpt)
+                return 0;
+
+        const tag_t *s = &reg.ckpt_s[id * reg.size];
+
+        reg.d = reg.ckpt_d[id];
+        for (uint64_t d = reg.d; d; d &= d - 1) {
+                int i = __builtin_ctzll(d);
+                reg.s[i] = s[i];
+        }
 
         return 1;
 }
 
+
 void reg_print(void) {
 
     printf("---------------------\n");
@@ -3,14 +3,24 @@
 
 #include "common.h"
 
-int reg_create(int size);
+// Bit of a register in a scoreboard mask
+static inline uint64_t reg_bit(uint8_t addr) {
+        return (uint64_t)1 << addr;
+}
+
+int reg_create(int size, int nb_ckpt);
 void reg_destroy(void);
 
 int reg_read_data(uint8_t addr, int32_t *data);
 int reg_write_data(uint8_t addr, int32_t data);
+int reg_commit(uint8_t addr, tag_t src, int32_t data);
+
+int reg_read_src(uint8_t addr, tag_t *src);
+int reg_write_src(uint8_t addr, tag_t src);
+int reg_undo(uint8_t addr, tag_t src, bool dirty);
 
-int reg_read_src(uint8_t addr, uint8_t *src);
-int reg_write_src(uint8_t addr, uint8_t src);
+int reg_checkpoint(int id);
+int reg_restore(int id);
 
 void reg_print(void);
 
@@ -0,0 +1,62 @@
+#include "ring.h"
+#include <sched.h>
+
+int ring_create(struct ring *r, int size) {
+        int n = 1 << clog2(size);
+
+        r->buf = malloc(sizeof(*r->buf) * n);
+        r->mask = n - 1;
+        r->tail_copy = 0;
+        r->head_copy = 0;
+        atomic_init(&r->head, 0);
+        atomic_init(&r->tail, 0);
+
+        if (!r->buf)
+                return ENOMEM;
+
+        return 0;
+}
+
+
+void ring_destroy(struct ring *r) {
+        if (r->buf)
+                free(r->buf);
+
+        r->buf = NULL;
+}
+
+
+int ring_push(struct ring *r, const struct trace_inst *t) {
+        uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+        if (tail - r->head_copy > r->mask) {
+                r->head_copy = atomic_load_explicit(&r->head, memory_order_acquire);
+                if (tail - r->head_copy > r->mask)
+                        return 0;
+        }
+
+        r->buf[tail & r->mask] = *t;
+        atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+        return 1;
+}
+
+
+const struct trace_inst *ring_peek(struct ring *r, uint32_t i) {
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+        while (r->tail_copy - head <= i) {
+                r->tail_copy = atomic_load_explicit(&r->tail, memory_order_acquire);
+                if (r->tail_copy - head <= i)
+                        sched_yield();
+        }
+
+        return &r->buf[(head + i) & r->mask];
+}
+
+
+void ring_pop(struct ring *r, uint32_t n) {
+        uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+        atomic_store_explicit(&r->head, head + n, memory_order_release);
+}
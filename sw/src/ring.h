@@ -0,0 +1,41 @@
+/* RING
+ * Lock-free single producer, single consumer ring of trace instructions.
+ * Each side owns its index and keeps a copy of the other one, it only
+ * reads the shared index again when its copy says the ring is full or
+ * empty.
+ */
+#ifndef __RING_H__
+#define __RING_H__
+
+#include "common.h"
+#include "trace.h"
+#include <stdatomic.h>
+
+struct ring {
+        struct trace_inst *buf;
+        uint32_t mask;
+
+        _Alignas(64) _Atomic uint32_t head;     // Next record to consume, written by the consumer
+        uint32_t tail_copy;
+
+        _Alignas(64) _Atomic uint32_t tail;     // Next record to produce, written by the producer
+        uint32_t head_copy;
+};
+
+// size is rounded up to a power of 2
+int ring_create(struct ring *r, int size);
+
+void ring_destroy(struct ring *r);
+
+// Producer, returns 0 if the ring is full
+int ring_push(struct ring *r, const struct trace_inst *t);
+
+/* \fn ring_peek
+ * \brief Consumer, waits for the record i places after the head
+ */
+const struct trace_inst *ring_peek(struct ring *r, uint32_t i);
+
+// Consumer, frees the n oldest records
+void ring_pop(struct ring *r, uint32_t n);
+
+#endif
@@ -12,10 +12,15 @@ struct rob_data {
         uint8_t dest; // Address to write the data in the regfile (RD)
         int32_t data; // Data to write in the register
         bool done;    // If the data is ready
+        bool fused;   // Entry holds a fused pair of instructions
+
+        // Physical register mode
+        tag_t preg;   // Physical register allocated to dest
+        tag_t prev;   // Physical register previously mapped to dest
 };
 
 
-static struct rob_ctrl {
+static CORE_LOCAL struct rob_ctrl {
         // Control
         int commit_ptr;
         int issue_ptr;
@@ -31,7 +36,7 @@ static struct rob_ctrl {
 
 // Creates the rob structure
 int rob_create(int size) {
-        if (rob.size != 0 || size == 0)
+        if (rob.size != 0 || size == 0 || (uint64_t)size > TAG_COUNT)
                 return -1;
 
         rob.data = malloc(sizeof(struct rob_data) * size);
@@ -56,7 +61,7 @@ void rob_destroy(void) {
 
 
 // Allocates a space in the rob & returns the address of the rob entry
-int rob_issue(uint8_t dest, uint8_t *src) {
+int rob_issue(uint8_t dest, tag_t *src) {
 
         int issue_ptr;
 
@@ -67,6 +72,7 @@ int rob_issue(uint8_t dest, uint8_t *src) {
         issue_ptr = rob.issue_ptr;
         rob.data[issue_ptr].dest = dest;
         rob.data[issue_ptr].done = 0;
+        rob.data[issue_ptr].fused = 0;
 
         // Update rob issue ptr
         rob.issue_ptr = (rob.issue_ptr + 1) % rob.size;
@@ -80,7 +86,7 @@ int rob_issue(uint8_t dest, uint8_t *src) {
 
 
 // Writes the data at the specified address in the rob
-int rob_write(uint8_t addr, int32_t data) {
+int rob_write(tag_t addr, int32_t data) {
         if (addr > rob.size)
                 return 0;
 
@@ -91,7 +97,69 @@ int rob_write(uint8_t addr, int32_t data) {
 }
 
 
-int rob_read(uint8_t addr, int32_t *data) {
+// Marks the entry as done without storing the data, used when the values
+// live in the physical register file
+int rob_set_done(tag_t addr) {
+        if (addr >= rob.size)
+                return 0;
+
+        rob.data[addr].done = 1;
+
+        return 1;
+}
+
+
+int rob_rename(tag_t addr, tag_t preg, tag_t prev) {
+        if (addr >= rob.size)
+                return 0;
+
+        rob.data[addr].preg = preg;
+        rob.data[addr].prev = prev;
+
+        return 1;
+}
+
+
+int rob_read_rename(tag_t addr, tag_t *preg, tag_t *prev) {
+        if (addr >= rob.size || !preg || !prev)
+                return 0;
+
+        *preg = rob.data[addr].preg;
+        *prev = rob.data[addr].prev;
+
+        return 1;
+}
+
+
+int rob_read_dest(tag_t addr, uint8_t *dest) {
+        if (addr >= rob.size || !dest)
+                return 0;
+
+        *dest = rob.data[addr].dest;
+
+        return 1;
+}
+
+
+int rob_set_fused(tag_t addr) {
+        if (addr >= rob.size)
+                return 0;
+
+        rob.data[addr].fused = 1;
+
+        return 1;
+}
+
+
+int rob_fused(tag_t addr) {
+        if (addr >= rob.size)
+                return 0;
+
+        return rob.data[addr].fused;
+}
+
+
+int rob_read(tag_t addr, int32_t *data) {
         if (addr > rob.size)
                 return 0;
 
@@ -101,8 +169,18 @@ int rob_read(uint8_t addr, int32_t *data) {
 }
 
 
+// Oldest entry, returns 0 if the ROB is empty
+int rob_head(tag_t *src) {
+        if (rob.cnt == 0)
+                return 0;
+
+        *src = rob.commit_ptr;
+        return 1;
+}
+
+
 // Commits a value if it is ready
-int rob_commit(uint8_t *src, uint8_t *dest, int32_t *data) {
+int rob_commit(tag_t *src, uint8_t *dest, int32_t *data) {
 
         if (rob.cnt == 0)
                 return 0;
@@ -129,6 +207,43 @@ void rob_flush(void) {
 }
 
 
+// Removes every entry younger than addr, returns the number of entries removed
+int rob_squash(tag_t addr) {
+        int n = (rob.issue_ptr - addr - 1 + rob.size) % rob.size;
+
+        rob.issue_ptr = (addr + 1) % rob.size;
+        rob.cnt -= n;
+
+        return n;
+}
+
+
+// Position of an entry from the head of the rob, 0 is the oldest
+int rob_age(tag_t addr) {
+        return (addr - rob.commit_ptr + rob.size) % rob.size;
+}
+
+
+// Returns 1 if the entry holds an instruction that has not committed
+int rob_busy(tag_t addr) {
+        if (addr >= rob.size)
+                return 0;
+
+        return rob_age(addr) < rob.cnt;
+}
+
+
+void rob_ptr(int *rd_ptr, int *wr_ptr) {
+        *rd_ptr = rob.commit_ptr;
+        *wr_ptr = rob.issue_ptr;
+}
+
+
+int rob_free(void) {
+        return rob.size - rob.cnt;
+}
+
+
 int rob_full(void) {
         if (rob.size == rob.cnt)
                 return 1;
@@ -136,3 +251,11 @@ int rob_full(void) {
         return 0;
 }
 
+
+
+int rob_empty(void) {
+        if (rob.cnt == 0)
+                return 1;
+
+        return 0;
+}
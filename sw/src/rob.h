@@ -5,7 +5,8 @@
 
 /* \fn rob_create
  * \param size The size of the
- * \return -1 if size = 0 or current rob not deallocated
+ * \return -1 if size = 0, size does not fit in a tag or current rob not
+ *         deallocated
  *         -2 memory error
  * \brief
  */
@@ -16,16 +17,43 @@ int rob_create(int size);
  */
 void rob_destroy(void);
 
-int rob_issue(uint8_t dest, uint8_t *src);
+int rob_issue(uint8_t dest, tag_t *src);
 
-int rob_write(uint8_t addr, int32_t data);
+int rob_write(tag_t addr, int32_t data);
 
-int rob_read(uint8_t addr, int32_t *data);
+int rob_read(tag_t addr, int32_t *data);
 
-int rob_commit(uint8_t *src, uint8_t *dest, int32_t *data);
+int rob_set_done(tag_t addr);
+
+int rob_rename(tag_t addr, tag_t preg, tag_t prev);
+
+int rob_read_rename(tag_t addr, tag_t *preg, tag_t *prev);
+
+int rob_read_dest(tag_t addr, uint8_t *dest);
+
+int rob_set_fused(tag_t addr);
+
+int rob_fused(tag_t addr);
+
+int rob_head(tag_t *src);
+
+int rob_commit(tag_t *src, uint8_t *dest, int32_t *data);
 
 void rob_flush(void);
 
+int rob_squash(tag_t addr);
+
+int rob_age(tag_t addr);
+
+int rob_busy(tag_t addr);
+
+// Commit and issue pointers, rd_ptr and wr_ptr of hw/src/rgu/rob.vhd
+void rob_ptr(int *rd_ptr, int *wr_ptr);
+
+int rob_free(void);
+
 int rob_full(void);
 
+int rob_empty(void);
+
 #endif
@@ -0,0 +1,143 @@
+#include "smp.h"
+#include <pthread.h>
+
+static struct smp {
+        struct engine_parameters param;
+        int nb_cores;
+        int quantum;
+        uint64_t max_cycles;
+        pthread_barrier_t barrier;
+
+        struct smp_core {
+                pthread_t thread;
+                int id;
+                int retval;
+                bool done;      // Written before the barrier, read after it
+                struct engine_stats *stats;
+                char **profile;
+        } core[MEM_MAX_CORES];
+} smp = {0};
+
+
+static void *core_run(void *arg) {
+        struct smp_core *c = arg;
+        struct engine_parameters param = smp.param;
+        uint64_t cycles = 0;
+        bool all_done = false;
+        int err = 0;
+
+        param.core = c->id;
+        param.nb_cores = smp.nb_cores;
+
+        // A core that can't start is done, the others still need it at the
+        // barrier
+        c->retval = engine_init(&param);
+        c->done = c->retval != 0;
+
+        while (!all_done) {
+                for (int q = 0; q < smp.quantum && !c->done; q++) {
+                        int r = engine_run();
+                        c->done = r != 0 || (smp.max_cycles && ++cycles >= smp.max_cycles);
+                }
+
+                pthread_barrier_wait(&smp.barrier);
+
+                // A store lost by any core stops every core at the same
+                // quantum, before one of them reads a stale byte
+                err = mem_sync();
+                if (c->id == 0 && !c->retval && !err)
+                        mem_atomics();
+                if (c->id == 0)
+                        coh_apply();
+                all_done = true;
+                for (int i = 0; i < smp.nb_cores; i++)
+                        all_done &= smp.core[i].done;
+
+                pthread_barrier_wait(&smp.barrier);
+
+                mem_clear_log();
+                if (!err)
+                        err = mem_sync_atomics();
+                if (!c->retval && !err)
+                        cache_sync();
+                all_done |= err != 0;
+        }
+
+        // The profiles are printed with the statistics, once every core is done
+        if (!c->retval) {
+                size_t size;
+                FILE *f;
+
+                engine_get_stats(c->stats);
+                if ((param.profile || param.functions || param.critical) && (f = open_memstream(c->profile, &size))) {
+                        engine_profile(f);
+                        fclose(f);
+                }
+                engine_destroy();
+        }
+
+        if (err && !c->retval)
+                c->retval = err;
+
+        return NULL;
+}
+
+
+int smp_run(const struct engine_parameters *param, int nb_cores, int quantum,
+        uint64_t max_cycles, struct engine_stats *stats, char **profile) {
+        int retval = 0, nb_threads = 0;
+
+        if (quantum < 1 || param->frontend != FRONTEND_INTEGRATED)
+                return EINVAL;
+
+        if ((retval = mem_share(nb_cores)))
+                return retval;
+
+        // The directory tracks the lines of every L1D
+        if (param->l1d.size && param->l1d.coherence != COH_NONE
+                && (retval = coh_create(nb_cores, param->mem_size, param->l1d.line_size))) {
+                mem_unshare();
+                return retval;
+        }
+
+        smp = (struct smp) {
+                .param = *param,
+                .nb_cores = nb_cores,
+                .quantum = quantum,
+                .max_cycles = max_cycles,
+        };
+
+        if (pthread_barrier_init(&smp.barrier, NULL, nb_cores)) {
+                coh_destroy();
+                mem_unshare();
+                return ENOMEM;
+        }
+
+        for (int i = 0; i < nb_cores; i++) {
+                profile[i] = NULL;
+                smp.core[i] = (struct smp_core) {.id = i, .stats = &stats[i], .profile = &profile[i]};
+                if (pthread_create(&smp.core[i].thread, NULL, core_run, &smp.core[i])) {
+                        retval = EAGAIN;
+                        break;
+                }
+                nb_threads++;
+        }
+
+        // Threads already started would wait forever on the barrier
+        if (nb_threads < nb_cores) {
+                fprintf(stderr, "Could only start %d of %d cores\n", nb_threads, nb_cores);
+                exit(retval);
+        }
+
+        for (int i = 0; i < nb_cores; i++) {
+                pthread_join(smp.core[i].thread, NULL);
+                if (smp.core[i].retval && !retval)
+                        retval = smp.core[i].retval;
+        }
+
+        pthread_barrier_destroy(&smp.barrier);
+        coh_destroy();
+        mem_unshare();
+
+        return retval;
+}
@@ -0,0 +1,24 @@
+/* SMP
+ * Cluster of cores sharing the guest memory, every core is an engine
+ * simulated by its own thread. The cores run in lockstep quanta: each one
+ * simulates a quantum of cycles on its own copy of the memory, then all
+ * of them wait on a barrier and apply the stores of the quantum in core
+ * order. A store is seen by the other cores at the next quantum, so the
+ * cycles of every core only depend on the program and the quantum. The
+ * L1D coherence directory is updated at the same time.
+ */
+#ifndef __SMP_H__
+#define __SMP_H__
+
+#include "common.h"
+#include "engine.h"
+
+/* \fn smp_run
+ * \brief Runs nb_cores copies of the core until all of them halt or reach
+ *        max_cycles (0 = no limit), stats gets one entry per core and
+ *        profile the hotspot report of every core, to be freed
+ */
+int smp_run(const struct engine_parameters *param, int nb_cores, int quantum,
+        uint64_t max_cycles, struct engine_stats *stats, char **profile);
+
+#endif
@@ -0,0 +1,278 @@
+#include "trace.h"
+#include "decoder.h"
+#include "lz.h"
+
+#define TRACE_MAGIC     "RVT1"
+#define TRACE_MAX_REC   32      // Header byte, 4 bytes encoding and 3 varints
+
+// Header of a record
+#define TR_PC           0x01    // PC does not follow the previous record
+#define TR_INST         0x02    // Encoding differs from the last visit
+#define TR_TAKEN        0x04    // Branch or JAL to its encoded target
+#define TR_NPC          0x08    // Any other redirect, JALR
+#define TR_ADDR         0x10    // Address differs from the prediction
+
+
+static void put32(uint8_t *p, uint32_t v) {
+        for (int i = 0; i < 4; i++)
+                p[i] = v >> (8 * i);
+}
+
+
+static uint32_t get32(const uint8_t *p) {
+        return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static int put_var(uint8_t *p, int32_t d) {
+        uint32_t v = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+        int n = 0;
+
+        for (; v >= 0x80; v >>= 7)
+                p[n++] = v | 0x80;
+        p[n++] = v;
+
+        return n;
+}
+
+
+static int32_t get_var(struct trace_file *t) {
+        uint32_t v = 0;
+
+        for (int s = 0; s < 35 && t->pos < t->len; s += 7) {
+                uint8_t b = t->raw[t->pos++];
+                v |= (uint32_t)(b & 0x7F) << s;
+                if (!(b & 0x80))
+                        break;
+        }
+
+        return (v >> 1) ^ -(v & 1);
+}
+
+
+static bool is_mem(uint32_t inst) {
+        uint8_t op = decode(inst).opcode;
+        return op == OP_LOAD || op == OP_STORE || op == OP_AMO;
+}
+
+
+// Target of a branch or JAL taken to its encoded offset
+static bool target(uint32_t inst, uint32_t pc, uint32_t *npc) {
+        struct inst_field i = decode(inst);
+
+        *npc = pc + i.immediate;
+        return i.opcode == OP_BRANCH || i.opcode == OP_JAL;
+}
+
+
+// Entry of a PC, a new PC starts without history
+static struct trace_pc *lookup(struct trace_file *t, uint32_t pc) {
+        struct trace_pc *e = &t->table[(pc >> 2) % TRACE_TABLE];
+
+        if (e->pc != pc)
+                *e = (struct trace_pc) {.pc = pc};
+
+        return e;
+}
+
+
+static void update(struct trace_pc *e, uint32_t addr) {
+        e->stride = addr - e->addr;
+        e->addr = addr;
+}
+
+
+static int flush(struct trace_file *t) {
+        uint8_t h[8];
+        int n = t->len ? lz_compress(t->raw, t->len, t->lz) : 0;
+
+        put32(h, t->len);
+        put32(h + 4, n);
+        if (fwrite(h, 1, 8, t->f) != 8 || fwrite(t->lz, 1, n, t->f) != (size_t)n)
+                return EIO;
+
+        t->bytes += 8 + n;
+        t->len = 0;
+
+        return 0;
+}
+
+
+static int fill(struct trace_file *t) {
+        uint8_t h[8];
+
+        t->len = t->pos = 0;
+        if (fread(h, 1, 8, t->f) != 8)
+                return -1;
+
+        uint32_t len = get32(h), n = get32(h + 4);
+        if (len == 0) {
+                t->bytes += 8;
+                return 0;
+        }
+
+        if (len > TRACE_BLOCK || n > LZ_BOUND(TRACE_BLOCK) || fread(t->lz, 1, n, t->f) != n
+                || lz_decompress(t->lz, n, t->raw, TRACE_BLOCK) != (int)len)
+                return -1;
+
+        t->bytes += 8 + n;
+        t->len = len;
+
+        return 1;
+}
+
+
+int trace_open(struct trace_file *t, const char *fn, bool write) {
+        char magic[4];
+
+        *t = (struct trace_file) {0};
+        t->write = write;
+        t->raw = malloc(TRACE_BLOCK);
+        t->lz = malloc(LZ_BOUND(TRACE_BLOCK));
+        t->table = calloc(TRACE_TABLE, sizeof(*t->table));
+
+        if (!t->raw || !t->lz || !t->table)
+                goto CLEANUP;
+
+        if (!(t->f = fopen(fn, write ? "wb" : "rb"))) {
+                int e = errno;
+                trace_close(t);
+                return e;
+        }
+
+        if (write) {
+                fwrite(TRACE_MAGIC, 1, 4, t->f);
+        } else if (fread(magic, 1, 4, t->f) != 4 || memcmp(magic, TRACE_MAGIC, 4)) {
+                trace_close(t);
+                return EINVAL;
+        }
+        t->bytes = 4;
+
+        return 0;
+
+CLEANUP:
+        trace_close(t);
+        return ENOMEM;
+}
+
+
+int trace_close(struct trace_file *t) {
+        int retval = 0;
+
+        // An empty block ends the trace
+        if (t->f && t->write) {
+                if (t->len)
+                        retval = flush(t);
+                if (!retval)
+                        retval = flush(t);
+        }
+
+        if (t->f && fclose(t->f) && !retval)
+                retval = EIO;
+
+        if (t->raw)
+                free(t->raw);
+        if (t->lz)
+                free(t->lz);
+        if (t->table)
+                free(t->table);
+
+        t->f = NULL;
+        t->raw = t->lz = NULL;
+        t->table = NULL;
+
+        return retval;
+}
+
+
+int trace_write(struct trace_file *t, const struct trace_inst *r) {
+        uint8_t *p = &t->raw[t->len];
+        uint8_t h = 0;
+        int n = 1;
+
+        struct trace_pc *e = lookup(t, r->pc);
+        uint32_t npc;
+
+        if (r->pc != t->pc) {
+                h |= TR_PC;
+                n += put_var(&p[n], r->pc - t->pc);
+        }
+
+        if (r->inst != e->inst) {
+                h |= TR_INST;
+                put32(&p[n], r->inst);
+                n += 4;
+                e->inst = r->inst;
+        }
+
+        if (r->npc != r->pc + 4) {
+                if (target(r->inst, r->pc, &npc) && npc == r->npc) {
+                        h |= TR_TAKEN;
+                } else {
+                        h |= TR_NPC;
+                        n += put_var(&p[n], r->npc - r->pc);
+                }
+        }
+
+        if (is_mem(r->inst)) {
+                if (r->addr != e->addr + e->stride) {
+                        h |= TR_ADDR;
+                        n += put_var(&p[n], r->addr - (e->addr + e->stride));
+                }
+                update(e, r->addr);
+        }
+
+        p[0] = h;
+        t->len += n;
+        t->pc = r->npc;
+        t->records++;
+
+        if (t->len > TRACE_BLOCK - TRACE_MAX_REC)
+                return flush(t);
+
+        return 0;
+}
+
+
+int trace_read(struct trace_file *t, struct trace_inst *r) {
+        if (t->pos == t->len) {
+                int e = fill(t);
+                if (e <= 0)
+                        return e;
+        }
+
+        uint8_t h = t->raw[t->pos++];
+
+        r->pc = t->pc;
+        if (h & TR_PC)
+                r->pc += get_var(t);
+
+        struct trace_pc *e = lookup(t, r->pc);
+
+        if (h & TR_INST) {
+                if (t->len - t->pos < 4)
+                        return -1;
+                e->inst = get32(&t->raw[t->pos]);
+                t->pos += 4;
+        }
+        r->inst = e->inst;
+
+        r->npc = r->pc + 4;
+        if (h & TR_TAKEN)
+                target(r->inst, r->pc, &r->npc);
+        else if (h & TR_NPC)
+                r->npc = r->pc + get_var(t);
+
+        r->addr = 0;
+        if (is_mem(r->inst)) {
+                r->addr = e->addr + e->stride;
+                if (h & TR_ADDR)
+                        r->addr += get_var(t);
+                update(e, r->addr);
+        }
+
+        t->pc = r->npc;
+        t->records++;
+
+        return 1;
+}
@@ -0,0 +1,58 @@
+/* TRACE
+ * Dynamic instruction produced by a functional frontend, it is everything
+ * the timing backend needs to model the instruction without executing it.
+ *
+ * Traces are saved as blocks of records compressed with lz.c. A record is
+ * a header byte followed by the fields the decoder can't predict: the PC
+ * follows the previous record, the encoding and the address of a load or
+ * store are predicted from the last visit of the same PC (address plus
+ * stride) and the target of a taken branch or JAL comes from its encoding.
+ * Only the misses are written, as zigzag varints of the difference.
+ */
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include "common.h"
+
+struct trace_inst {
+        uint32_t pc;
+        uint32_t inst;  // Encoded instruction, 0 ends the trace
+        uint32_t addr;  // Effective address of a load or store
+        uint32_t npc;   // Address of the next instruction, branch outcome
+};
+
+#define TRACE_TABLE     4096            // PCs remembered by the encoder
+#define TRACE_BLOCK     (1 << 16)       // Bytes of records compressed at once
+
+struct trace_file {
+        FILE *f;
+        bool write;
+        uint8_t *raw;           // Records of the current block
+        uint8_t *lz;            // Compressed block
+        int len;                // Bytes in raw
+        int pos;                // Read position in raw
+        uint32_t pc;            // Predicted PC of the next record
+        struct trace_pc {
+                uint32_t pc, inst, addr;
+                int32_t stride;
+        } *table;
+
+        uint64_t records;
+        uint64_t bytes;         // Size of the file
+};
+
+/* \fn trace_open
+ * \brief Opens a trace file to record (write) or replay
+ * \return 0, ENOMEM, EINVAL if the file is not a trace or errno of fopen
+ */
+int trace_open(struct trace_file *t, const char *fn, bool write);
+
+// Flushes a recorded trace
+int trace_close(struct trace_file *t);
+
+int trace_write(struct trace_file *t, const struct trace_inst *r);
+
+// Returns 0 at the end of the trace, -1 if it is corrupt
+int trace_read(struct trace_file *t, struct trace_inst *r);
+
+#endif
@@ -1,35 +1,52 @@
 #include "unit.h"
+#include "decoder.h"
 
 #define F3_MAX 8
 
 int32_t alu_exec(int16_t f10, int32_t a, int32_t b) {
         switch(f10) {
-                //I
-                case F10_ADD    : return a + b;
-                case F10_SLL    : return a << b;
+                // I, the arithmetic wraps so it is done unsigned
+                case F10_ADD    : return (int32_t)((uint32_t)a + (uint32_t)b);
+                case F10_SLL    : return (int32_t)((uint32_t)a << (b & 0x1F));
                 case F10_SLT    : return a < b;
                 case F10_SLTU   : return (uint32_t)a < (uint32_t)b;
                 case F10_XOR    : return a ^ b;
-                case F10_SRL    : return (uint32_t)a >> (uint32_t)b;
+                case F10_SRL    : return (uint32_t)a >> (b & 0x1F);
                 case F10_OR     : return a | b;
                 case F10_AND    : return a & b;
-                case F10_SUB    : return a - b;
-                case F10_SRA    : return a >> b;
+                case F10_SUB    : return (int32_t)((uint32_t)a - (uint32_t)b);
+                case F10_SRA    : return a >> (b & 0x1F);
 
                 // M
-                case F10_MUL    : return a * b;
+                case F10_MUL    : return (int32_t)((uint32_t)a * (uint32_t)b);
                 case F10_MULH   : return (((int64_t) a * (int64_t) b) >> 32);
                 case F10_MULHSU : return (((int64_t) a * (uint64_t) b) >> 32);
                 case F10_MULHU  : return (((uint64_t) a * (uint64_t) b) >> 32);
-                case F10_DIV    : return a / b;
-                case F10_DIVU   : return (uint32_t)a / (uint32_t)b;
-                case F10_REM    : return a % b; // VERIFY: SIGN of return = SIGN OF DIVIDEND by spec
-                case F10_REMU   : return (uint32_t)a % (uint32_t)b;
+                // Division by zero and overflow results are defined by the spec
+                case F10_DIV    : return b == 0 ? -1 : (a == INT32_MIN && b == -1) ? a : a / b;
+                case F10_DIVU   : return b == 0 ? -1 : (int32_t)((uint32_t)a / (uint32_t)b);
+                case F10_REM    : return b == 0 ? a : (a == INT32_MIN && b == -1) ? 0 : a % b;
+                case F10_REMU   : return b == 0 ? a : (int32_t)((uint32_t)a % (uint32_t)b);
 
                 default : return 0;
         }
 }
 
+int32_t amo_exec(uint8_t funct5, int32_t mem, int32_t src) {
+        switch(funct5) {
+                case FUNCT5_AMOSWAP : return src;
+                case FUNCT5_AMOADD  : return (int32_t)((uint32_t)mem + (uint32_t)src);
+                case FUNCT5_AMOXOR  : return mem ^ src;
+                case FUNCT5_AMOAND  : return mem & src;
+                case FUNCT5_AMOOR   : return mem | src;
+                case FUNCT5_AMOMIN  : return mem < src ? mem : src;
+                case FUNCT5_AMOMAX  : return mem > src ? mem : src;
+                case FUNCT5_AMOMINU : return (uint32_t)mem < (uint32_t)src ? mem : src;
+                case FUNCT5_AMOMAXU : return (uint32_t)mem > (uint32_t)src ? mem : src;
+                default             : return mem;
+        }
+}
+
 int alu_get_cycle(int16_t f10) {
         switch(f10) {
                 // I
@@ -56,7 +73,7 @@ int alu_get_cycle(int16_t f10) {
                 case F10_DIVU   :
                 case F10_REM    :
                 case F10_REMU   :
-                        return 19;
+                        return DIV_LATENCY;
 
                 default :
                         return 0;
@@ -64,3 +81,64 @@ int alu_get_cycle(int16_t f10) {
 
 }
 
+
+// Unit pool able to execute the instruction
+enum unit_type unit_get_type(uint8_t opcode, int16_t f10) {
+        switch(opcode) {
+                case OP_LOAD:
+                case OP_STORE:
+                case OP_AMO:
+                        return UNIT_AGU;
+
+                case OP_BRANCH:
+                case OP_JAL:
+                case OP_JALR:
+                        return UNIT_BRU;
+
+                case OP_OP:
+                        switch(f10) {
+                                case F10_MUL    :
+                                case F10_MULH   :
+                                case F10_MULHSU :
+                                case F10_MULHU  :
+                                        return UNIT_MUL;
+
+                                case F10_DIV    :
+                                case F10_DIVU   :
+                                case F10_REM    :
+                                case F10_REMU   :
+                                        return UNIT_DIV;
+                        }
+                        // fall through
+
+                default:
+                        return UNIT_ALU;
+        }
+}
+
+
+// Jumps return the link address, branches return 1 if taken
+int32_t bru_exec(int16_t f10, uint8_t opcode, uint32_t pc, int32_t a, int32_t b) {
+        if (opcode != OP_BRANCH)
+                return pc + 4;
+
+        switch(f10 & 0x7) {
+                case FUNCT3_BEQ  : return a == b;
+                case FUNCT3_BNE  : return a != b;
+                case FUNCT3_BLT  : return a < b;
+                case FUNCT3_BGE  : return a >= b;
+                case FUNCT3_BLTU : return (uint32_t)a < (uint32_t)b;
+                case FUNCT3_BGEU : return (uint32_t)a >= (uint32_t)b;
+                default          : return 0;
+        }
+}
+
+
+// Address of the next instruction once the branch or jump is resolved
+uint32_t bru_next_pc(int16_t f10, uint8_t opcode, uint32_t pc, int32_t a, int32_t b, int32_t imm) {
+        switch(opcode) {
+                case OP_JAL  : return pc + imm;
+                case OP_JALR : return (a + imm) & ~1;
+                default      : return bru_exec(f10, opcode, pc, a, b) ? pc + imm : pc + 4;
+        }
+}
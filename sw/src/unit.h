@@ -18,8 +18,8 @@
 #define F10_SRL         0x005
 #define F10_OR          0x006
 #define F10_AND         0x007
-#define F10_SUB         0x200
-#define F10_SRA         0x205
+#define F10_SUB         0x100
+#define F10_SRA         0x105
 
 // M
 #define F10_MUL         0x008
@@ -35,6 +35,23 @@
 #define DIV_LATENCY 19
 
 
+enum unit_type {
+        UNIT_ALU,       // Integer operations
+        UNIT_MUL,       // Multiplications
+        UNIT_DIV,       // Divisions and remainders
+        UNIT_AGU,       // Address generation for loads and stores
+        UNIT_BRU,       // Branches and jumps
+        NB_UNIT_TYPES
+};
+
+
+struct unit_pool_param {
+        int count;      // Number of units in the pool
+        int latency;    // Cycles from issue to result
+        int interval;   // Initiation interval, cycles before a unit accepts a new op
+};
+
+
 enum INT_EXTENSION {
         M = 1,
         A = 2,
@@ -45,6 +62,15 @@ enum INT_EXTENSION {
 
 int32_t alu_exec(int16_t f10, int32_t a, int32_t b);
 
+// Value an AMO writes back to memory from the one it read
+int32_t amo_exec(uint8_t funct5, int32_t mem, int32_t src);
+
 int alu_get_cycle(int16_t f10);
 
+enum unit_type unit_get_type(uint8_t opcode, int16_t f10);
+
+int32_t bru_exec(int16_t f10, uint8_t opcode, uint32_t pc, int32_t a, int32_t b);
+
+uint32_t bru_next_pc(int16_t f10, uint8_t opcode, uint32_t pc, int32_t a, int32_t b, int32_t imm);
+
 #endif
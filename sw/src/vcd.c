@@ -0,0 +1,231 @@
+#include "vcd.h"
+#include <inttypes.h>
+
+#define VCD_BUFFER      (1 << 20)       // Bytes buffered before a write
+#define VCD_DEPTH       4               // Levels of instances below the core
+
+struct vcd_signal {
+        char scope[64];
+        char name[32];
+        char id[5];             // Printable characters from ! to ~
+        int width;
+        uint64_t value;         // Set this cycle
+        uint64_t dumped;        // Last value written
+};
+
+static CORE_LOCAL struct vcd {
+        FILE *f;
+        char *buf;
+        uint64_t first, last;   // Window of cycles
+        uint64_t end;           // Time of the end of the last cycle written
+        bool header;            // Declarations written
+        bool dumped;            // Every value written once
+        bool failed;            // A declaration ran out of memory
+
+        int nb_signals;
+        int max_signals;
+        struct vcd_signal *s;
+} vcd = {0};
+
+
+static void header(void);
+
+
+void vcd_destroy(void) {
+        // A window past the end of the run still gives a valid file, with
+        // the signals and no values
+        if (vcd.f && !vcd.header && !vcd.failed) {
+                header();
+                vcd.end = vcd.first * VCD_PERIOD;
+        }
+
+        if (vcd.f) {
+                if (vcd.header)
+                        fprintf(vcd.f, "#%" PRIu64 "\n", vcd.end);
+                fclose(vcd.f);
+        }
+
+        // The buffer is used until the file is closed
+        if (vcd.buf)
+                free(vcd.buf);
+        if (vcd.s)
+                free(vcd.s);
+
+        vcd = (struct vcd) {0};
+}
+
+
+int vcd_create(const char *path, uint64_t first, uint64_t last) {
+        if (first > last)
+                return EINVAL;
+
+        vcd = (struct vcd) {
+                .first = first,
+                .last = last,
+        };
+
+        if (!(vcd.f = fopen(path, "w"))) {
+                fprintf(stderr, "Could not write the waveforms to %s\n", path);
+                return ENOENT;
+        }
+
+        if (!(vcd.buf = malloc(VCD_BUFFER)) || vcd_signal(NULL, "i_clk", 1) < 0) {
+                vcd_destroy();
+                return ENOMEM;
+        }
+
+        setvbuf(vcd.f, vcd.buf, _IOFBF, VCD_BUFFER);
+
+        return 0;
+}
+
+
+int vcd_signal(const char *scope, const char *name, int width) {
+        if (vcd.header || vcd.failed)
+                return -1;
+
+        if (vcd.nb_signals == vcd.max_signals) {
+                int n = vcd.max_signals ? 2 * vcd.max_signals : 32;
+                struct vcd_signal *s = realloc(vcd.s, n * sizeof(*s));
+
+                if (!s) {
+                        vcd.failed = true;
+                        return -1;
+                }
+
+                vcd.s = s;
+                vcd.max_signals = n;
+        }
+
+        int i = vcd.nb_signals++;
+        struct vcd_signal *s = &vcd.s[i];
+
+        *s = (struct vcd_signal) {.width = width < 1 ? 1 : width > 64 ? 64 : width};
+        snprintf(s->scope, sizeof(s->scope), "%s", scope ? scope : "");
+        snprintf(s->name, sizeof(s->name), "%s", name);
+
+        char *id = s->id;
+        do {
+                *id++ = '!' + i % 94;
+                i /= 94;
+        } while (i);
+
+        return vcd.nb_signals - 1;
+}
+
+
+bool vcd_window(uint64_t cycle) {
+        return vcd.f && cycle >= vcd.first && cycle <= vcd.last;
+}
+
+
+void vcd_set(int id, uint64_t value) {
+        struct vcd_signal *s = &vcd.s[id];
+
+        s->value = s->width < 64 ? value & (((uint64_t)1 << s->width) - 1) : value;
+}
+
+
+// Instances of a dotted scope
+static int split(char *scope, char *level[VCD_DEPTH]) {
+        char *save;
+        int n = 0;
+
+        for (char *t = strtok_r(scope, ".", &save); t && n < VCD_DEPTH; t = strtok_r(NULL, ".", &save))
+                level[n++] = t;
+
+        return n;
+}
+
+
+static void header(void) {
+        char path[2][64] = {""};
+        char *level[2][VCD_DEPTH];
+        int depth[2] = {0}, cur = 0;
+
+        fprintf(vcd.f, "$version sim $end\n$timescale 1ns $end\n$scope module core $end\n");
+
+        for (int i = 0; i < vcd.nb_signals; i++) {
+                const struct vcd_signal *s = &vcd.s[i];
+
+                // Leaves the instances that differ and enters the new ones
+                if (i == 0 || strcmp(s->scope, vcd.s[i - 1].scope)) {
+                        int next = !cur, k = 0;
+
+                        strcpy(path[next], s->scope);
+                        depth[next] = split(path[next], level[next]);
+
+                        while (k < depth[cur] && k < depth[next] && !strcmp(level[cur][k], level[next][k]))
+                                k++;
+                        for (int j = depth[cur]; j > k; j--)
+                                fprintf(vcd.f, "$upscope $end\n");
+                        for (int j = k; j < depth[next]; j++)
+                                fprintf(vcd.f, "$scope module %s $end\n", level[next][j]);
+
+                        cur = next;
+                }
+
+                if (s->width == 1)
+                        fprintf(vcd.f, "$var wire 1 %s %s $end\n", s->id, s->name);
+                else
+                        fprintf(vcd.f, "$var wire %d %s %s [%d:0] $end\n", s->width, s->id, s->name, s->width - 1);
+        }
+
+        for (int j = depth[cur]; j >= 0; j--)
+                fprintf(vcd.f, "$upscope $end\n");
+        fprintf(vcd.f, "$enddefinitions $end\n");
+
+        vcd.header = true;
+}
+
+
+static void write_value(struct vcd_signal *s) {
+        if (s->width == 1) {
+                fprintf(vcd.f, "%d%s\n", (int)s->value, s->id);
+        } else {
+                // Leading zeros are implied
+                char b[65];
+                int n = 0;
+
+                for (int i = s->width - 1; i >= 0; i--)
+                        if (n || (s->value >> i & 1) || i == 0)
+                                b[n++] = '0' + (s->value >> i & 1);
+                b[n] = 0;
+
+                fprintf(vcd.f, "b%s %s\n", b, s->id);
+        }
+
+        s->dumped = s->value;
+}
+
+
+void vcd_tick(uint64_t cycle) {
+        if (!vcd_window(cycle))
+                return;
+
+        if (!vcd.header)
+                header();
+
+        // The state sampled at the end of the cycle is shown from the
+        // rising edge, the first one dumps every value
+        struct vcd_signal *clk = &vcd.s[0];
+
+        fprintf(vcd.f, "#%" PRIu64 "\n", cycle * VCD_PERIOD);
+        clk->value = 1;
+
+        if (!vcd.dumped)
+                fprintf(vcd.f, "$dumpvars\n");
+
+        for (int i = 0; i < vcd.nb_signals; i++)
+                if (!vcd.dumped || vcd.s[i].value != vcd.s[i].dumped)
+                        write_value(&vcd.s[i]);
+
+        if (!vcd.dumped)
+                fprintf(vcd.f, "$end\n");
+        vcd.dumped = true;
+
+        fprintf(vcd.f, "#%" PRIu64 "\n0%s\n", cycle * VCD_PERIOD + VCD_PERIOD / 2, clk->id);
+        clk->value = clk->dumped = 0;
+
+        vcd.end = (cycle + 1) * VCD_PERIOD;
+}
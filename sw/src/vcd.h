@@ -0,0 +1,44 @@
+/* VALUE CHANGE DUMP
+ * Waveforms of the internal state of a core, to be overlaid in GTKWave on
+ * those of the RTL testbench (hw/sim/cmd.txt). The signals are named and
+ * scoped after hw/src/core.vhd and its instances, a cycle lasts 10 ns like
+ * the 100 MHz clock of core_tb.
+ *
+ * The signals are declared first, then every cycle the engine sets their
+ * values and vcd_tick writes those that changed. Only the cycles of the
+ * window are written, through a large stdio buffer.
+ */
+#ifndef __VCD_H__
+#define __VCD_H__
+
+#include "common.h"
+#include <stdio.h>
+
+#define VCD_PERIOD      10              // ns per cycle
+
+/* \fn vcd_create
+ * \brief Opens the file, the cycles from first to last are written. The
+ *        clock i_clk is the first signal
+ */
+int vcd_create(const char *path, uint64_t first, uint64_t last);
+
+// Writes the end of the last cycle and closes the file
+void vcd_destroy(void);
+
+/* \fn vcd_signal
+ * \param scope Instances separated by dots, like u_rgu.u_rob, NULL for the
+ *        core itself
+ * \return Id of the signal, -1 once the first cycle was written or without
+ *         memory, then for every later signal
+ */
+int vcd_signal(const char *scope, const char *name, int width);
+
+// The cycle is written, the engine only samples its state then
+bool vcd_window(uint64_t cycle);
+
+void vcd_set(int id, uint64_t value);
+
+// Writes the values that changed at the rising edge of the cycle
+void vcd_tick(uint64_t cycle);
+
+#endif